@@ -0,0 +1,185 @@
+#ifndef BLOCK_ASYNC_H
+#define BLOCK_ASYNC_H
+
+#include "buffer.h"
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <utility>
+#include <vector>
+
+/* coroutine front end for BufferedFile (C++20 builds only)
+ *
+ * a BlockTask is a coroutine that can co_await file.readBlockAsync(n).
+ * tasks are spawned on a BlockScheduler, which runs every task until it
+ * is either done or waiting on a block miss, then services all the
+ * waiting misses as one BufferedFile::readBlocks() batch and resumes the
+ * waiters. hundreds of lookups can be in flight on a single thread.
+ *
+ *	BlockTask lookup(BufferedFile& file, long n) {
+ *		BufferFrame* frame = co_await file.readBlockAsync(n);
+ *		...
+ *	}
+ *	BlockScheduler sched(&file);
+ *	sched.spawn(lookup(file, 4));
+ *	sched.run();
+ */
+
+class BlockScheduler;
+
+class BlockTask
+{
+public:
+	struct promise_type
+	{
+		BlockScheduler* scheduler = nullptr;
+		std::exception_ptr error;
+
+		BlockTask get_return_object() { return BlockTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { error = std::current_exception(); }
+	};
+
+	typedef std::coroutine_handle<promise_type> handle_type;
+
+private:
+	handle_type handle;
+
+public:
+	explicit BlockTask(handle_type h) : handle(h) {}
+	BlockTask(BlockTask&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+	BlockTask(const BlockTask&) = delete;
+	BlockTask& operator= (const BlockTask&) = delete;
+	~BlockTask() { if(handle) handle.destroy(); }
+
+	handle_type release() { return std::exchange(handle, nullptr); }
+};
+
+// the frame handed back by co_await has the same lifetime as one from readBlock()
+class BlockAwaiter
+{
+	friend class BlockScheduler;
+private:
+	BufferedFile* file;
+	long block_number;
+	BufferFrame* frame;
+	bool pinned;
+
+public:
+	BlockAwaiter(BufferedFile* f, long n) : file(f), block_number(n), frame(nullptr), pinned(false) {}
+
+	bool await_ready()
+	{
+		if(!file->isCached(block_number))
+			return false;
+
+		frame = file->readBlock(block_number);
+		return true;
+	}
+
+	void await_suspend(BlockTask::handle_type h);
+
+	BufferFrame* await_resume()
+	{
+		if(pinned)
+		{
+			frame->unpin();
+			pinned = false;
+		}
+		return frame;
+	}
+};
+
+class BlockScheduler
+{
+	BufferedFile* file;
+	std::vector<BlockTask::handle_type> tasks;
+	std::deque< std::coroutine_handle<> > ready;
+	std::deque< std::pair<BlockAwaiter*, std::coroutine_handle<> > > waiting;
+
+	void serviceMisses();
+
+public:
+	BlockScheduler(BufferedFile* f) : file(f) {}
+	~BlockScheduler()
+	{
+		for(size_t i = 0; i < tasks.size(); i++)
+			tasks[i].destroy();
+	}
+	BlockScheduler(const BlockScheduler&) = delete;
+	BlockScheduler& operator= (const BlockScheduler&) = delete;
+
+	void spawn(BlockTask task);
+	void wait(BlockAwaiter* awaiter, std::coroutine_handle<> h) { waiting.push_back({awaiter, h}); }
+
+	// runs until every spawned task has finished, rethrows the first task exception
+	void run();
+};
+
+inline void BlockAwaiter::await_suspend(BlockTask::handle_type h)
+{
+	h.promise().scheduler->wait(this, h);
+}
+
+inline void BlockScheduler::spawn(BlockTask task)
+{
+	BlockTask::handle_type h = task.release();
+	h.promise().scheduler = this;
+	tasks.push_back(h);
+	ready.push_back(h);
+}
+
+// at most half the pool is pinned by one batch, leaving frames for the resumed tasks
+inline void BlockScheduler::serviceMisses()
+{
+	size_t batch = file->getPoolSize() / 2;
+	if(batch < 1)
+		batch = 1;
+	if(batch > waiting.size())
+		batch = waiting.size();
+
+	std::vector<long> block_numbers(batch);
+	for(size_t i = 0; i < batch; i++)
+		block_numbers[i] = waiting[i].first->block_number;
+
+	std::vector<BufferFrame*> frames = file->readBlocks(block_numbers);
+
+	for(size_t i = 0; i < batch; i++)
+	{
+		waiting.front().first->frame = frames[i];
+		waiting.front().first->pinned = true;
+		ready.push_back(waiting.front().second);
+		waiting.pop_front();
+	}
+}
+
+inline void BlockScheduler::run()
+{
+	while(!ready.empty() || !waiting.empty())
+	{
+		while(!ready.empty())
+		{
+			std::coroutine_handle<> h = ready.front();
+			ready.pop_front();
+			h.resume();
+		}
+
+		if(!waiting.empty())
+			serviceMisses();
+	}
+
+	for(size_t i = 0; i < tasks.size(); i++)
+	{
+		if(tasks[i].promise().error)
+			std::rethrow_exception(tasks[i].promise().error);
+	}
+}
+
+inline BlockAwaiter BufferedFile::readBlockAsync(long block_number)
+{
+	return BlockAwaiter(this, block_number);
+}
+
+#endif
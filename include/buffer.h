@@ -1,13 +1,25 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
 #include <sys/stat.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <cstdio>
 #include <stddef.h>
 #include <stdint.h>
 #include <exception>
+#include <algorithm>
 #include <unordered_map>
 #include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <stdexcept>
+#include <vector>
+
+class BlockAwaiter;
 
 /* fixed size page buffer implementation
  * assuming one block header
@@ -25,44 +37,59 @@ public:
 	private:
 		bool is_valid;
 		bool is_dirty;
-		bool is_pinned;
+		int pin_count;
 		long block_number;
 		void* data;
+		// memory owned by the frame. data points here, or into the file mapping of a mapped read-only file
+		void* buffer;
 		const BufferedFile* file_ref;
 		
 		BufferFrame *next, *prev;
 	public:
-		BufferFrame(const BufferedFile* file) : is_valid(false), is_dirty(false), is_pinned(false), block_number(-1), next(nullptr), prev(nullptr), file_ref(file) { data = malloc(file->block_size); }
-		BufferFrame() : is_valid(false), is_dirty(false), is_pinned(false), block_number(-1), next(nullptr), prev(nullptr), file_ref(nullptr), data(nullptr) { }
-		~BufferFrame() { free(data); }
-		void setBufferedFile(const BufferedFile* file) { file_ref = file; data = malloc(file_ref->block_size); }
-		void pin() { is_pinned = true; };
-		void unpin() { is_pinned = false; };
+		BufferFrame(const BufferedFile* file) : is_valid(false), is_dirty(false), pin_count(0), block_number(-1), next(nullptr), prev(nullptr), file_ref(file) { data = buffer = malloc(file->block_size); }
+		BufferFrame() : is_valid(false), is_dirty(false), pin_count(0), block_number(-1), next(nullptr), prev(nullptr), file_ref(nullptr), data(nullptr), buffer(nullptr) { }
+		~BufferFrame() { free(buffer); }
+		void setBufferedFile(const BufferedFile* file) { file_ref = file; data = buffer = malloc(file_ref->block_size); }
+		// pins are counted, a frame is evictable again once every holder has unpinned it
+		void pin() { pin_count++; };
+		void unpin() { if(pin_count > 0) pin_count--; };
+		// -1 once the frame no longer holds a block
+		long getBlockNumber() const { return is_valid ? block_number : -1; }
 	};
 	
 	class BufferedFrameWriter
 	{
+		// read-only files never write frames back and a mapped frame is not even writable
+		static void checkWritable(const BufferFrame* frame)
+		{
+			if(frame->file_ref->isReadOnly())
+				throw std::runtime_error{"File opened read-only"};
+		}
+		
 	public:
 		static void memcpy(BufferFrame* frame, const void* src, size_t offset, size_t size)
 		{
+			checkWritable(frame);
 			frame->is_dirty = true;
 			std::memcpy(((char*)frame->data + offset), src, size);
 		}
 		
 		static void memset(BufferFrame* frame, char ch, size_t offset, size_t size)
 		{
+			checkWritable(frame);
 			frame->is_dirty = true;
 			std::memset(((char*)frame->data + offset), ch, size);
 		}
 		
 		static void memmove(BufferFrame* frame, const void* src, size_t offset, size_t size)
 		{
+			checkWritable(frame);
 			frame->is_dirty = true;
 			std::memmove(((char*)frame->data + offset), src, size);
 		}
 		
 		template <typename T>
-		static T write(BufferFrame* frame, size_t offset, const T& a)
+		static void write(BufferFrame* frame, size_t offset, const T& a)
 		{
 			memcpy(frame, &a, offset, sizeof(a));
 		}
@@ -77,9 +104,13 @@ public:
 			return *((T*)((char*)frame->data + offset));
 		}
 		
+		// a writable pointer, so the frame is taken to be dirty. read-only files never write
+		// frames back and a mapped frame is not even writable, so they refuse it.
 		template <typename T>
 		static T* readPtr(BufferFrame* frame, size_t offset)
 		{
+			if(frame->file_ref->isReadOnly())
+				throw std::runtime_error{"File opened read-only"};
 			frame->is_dirty = true;
 			return ((T*)((char*)frame->data + offset));
 		}
@@ -121,7 +152,7 @@ public:
 		{
 			for(auto i=0; i < pool_size; i++)
 			{
-				if(dllist[i].is_dirty)
+				if(dllist[i].is_dirty && dllist[i].file_ref->open_mode == READ_WRITE)
 				{
 					pwrite(dllist[i].file_ref->fd, dllist[i].data, dllist[i].file_ref->block_size, dllist[i].file_ref->getblockoffset(dllist[i].block_number));
 				}
@@ -136,7 +167,7 @@ public:
 		BufferFrame* getNewFrame()
 		{
 			BufferFrame* trav = head->next;
-			while(trav->is_pinned == true && trav != head)
+			while(trav->pin_count > 0 && trav != head)
 				trav = trav -> next;
 
 			return trav;
@@ -150,6 +181,7 @@ public:
 			head->prev->next = ptr;
 			head->prev = ptr;
 		}
+		// pins are left as they are, whoever holds one still unpins the frame
 		void removeFrame(BufferFrame* ptr)
 		{
 			ptr->next->prev = ptr->prev;
@@ -164,50 +196,149 @@ public:
 			ptr->block_number = -1;
 		}
 	};
+	
+	enum OpenMode {
+		READ_WRITE,         // exclusive lock, header and size written back on close
+		READ_ONLY,          // shared lock, nothing is ever written to the file
+		READ_ONLY_MAPPED    // READ_ONLY, blocks are served straight from a shared mapping of the file, never write to them
+	};
 
 private:
 	int fd;
+	const OpenMode open_mode;
 	const size_t block_size;
 	const int buffer_pool_size;
     
 	long last_block_alloted;
+	// blocks up to here already have disk space behind them, see reserveBlocks()
+	long last_block_reserved;
+	// blocks up to here are not truncated away on close, see keepBlocks()
+	long last_block_kept;
 
 	FramePool* frame_pool;
 	BufferFrame* header;
 	
 	std::unordered_map< long, BufferFrame* > block_hash;
+	
+	// READ_ONLY_MAPPED only, the whole file as it was when opened
+	char* mapping;
+	size_t mapping_size;
+	
+	// blocks read into frames from the file so far, for measuring I/O. mapped blocks are not read.
+	long blocks_read;
 
 	off_t getblockoffset(long blknbr) const { return (off_t) (blknbr * block_size); }
+	
+	// evicts a frame if needed and binds it to block_number, without reading the block
+	BufferFrame* assignFrame(long block_number);
+	void readRun(long first_block, struct iovec* iov, int count);
+	bool mapBlock(BufferFrame* frame);
+	// forgets cached frames of blocks [first_block, last_block] without writing them back
+	void dropFrames(long first_block, long last_block);
 
 public:
 	// default numbers are arbitrary. change to best value.
 	// reserved_memory is the size of buffer pool in main memory to be reserved for the application.
-	BufferedFile(const char* filepath, size_t blksize = 4096, size_t reserved_memory = 1048576);
+	BufferedFile(const char* filepath, size_t blksize = 4096, size_t reserved_memory = 1048576, OpenMode mode = READ_WRITE);
 	~BufferedFile();
 	BufferFrame* readBlock(long block_number);
+	// returned frames are pinned, unpin each of them when done.
+	std::vector<BufferFrame*> readBlockRange(long first_block, long count);
+	// reads any set of blocks, each run of consecutive misses with one preadv in disk order.
+	// handles come back in the order of block_numbers, each one pinned.
+	std::vector<BufferFrame*> readBlocks(const std::vector<long>& block_numbers);
+#if defined(__cpp_impl_coroutine)
+	// co_await file.readBlockAsync(n) from a BlockTask, see block_async.h
+	BlockAwaiter readBlockAsync(long block_number);
+#endif
+	bool isCached(long block_number) const { return block_hash.count(block_number) != 0; }
 	void writeBlock(long block_number);
 	BufferFrame* readHeader(); 
 	void writeHeader();
 	long allotBlock();
+	// allots a new block and hands back a zeroed frame for it, the disk is not read
+	BufferFrame* allotFrame();
+	// writes count blocks from src straight to the file, bypassing the pool. frames
+	// cached for these blocks are not updated, so meant for blocks not in the pool.
+	// only touches the file descriptor, safe to call from several threads.
+	void writeBlocksDirect(long first_block, long count, const void* src) const;
+	// reads count blocks into dst without touching the pool, the thread-safe read path.
+	// dirty frames are not seen, flush() first. blocks past the end read as zeros.
+	void readBlocksDirect(long first_block, long count, void* dst) const;
+	// the same for any byte range of the file, writes to disjoint ranges may run concurrently
+	void writeBytesDirect(off_t offset, size_t size, const void* src) const;
+	void readBytesDirect(off_t offset, size_t size, void* dst) const;
+	// asks the kernel to start reading the blocks in, safe from any thread
+	void prefetchBlocks(long first_block, long count) const;
+	// tells the kernel how the whole file will be read, a POSIX_FADV_* value
+	void adviseAccess(int advice) const;
+	// writes every dirty frame back
+	void flush();
+	// writes back and forgets the cached frames of these blocks, so direct writes to them cannot go stale
+	void evictBlocks(long first_block, long count);
+	// frees block_number and every block after it, their space is given back in steps
 	void deleteBlock(long block_number);
+	// makes sure disk space is allocated for every block up to last_block
+	void reserveBlocks(long last_block);
+	// reserves blocks up to last_block and keeps them when the file is closed
+	void keepBlocks(long last_block);
+	// gives the space preallocated past the last alloted block back to the filesystem
+	void trimBlocks();
+	// gives the space of blocks in the middle of the file back to the filesystem, they read back as zeros
+	void punchBlocks(long first_block, long count);
+	int getPoolSize() const { return buffer_pool_size; }
+	long getLastBlock() const { return last_block_alloted; }
+	long getReservedBlocks() const { return last_block_reserved; }
+	bool isReadOnly() const { return open_mode != READ_WRITE; }
+	long getBlocksRead() const { return blocks_read; }
+	
+	// the file grows in steps of at least this many bytes, or an eighth of its size
+	static const size_t preallocate_bytes = 1048576;
 };
 
-BufferedFile::BufferedFile(const char* filepath, size_t blksize, size_t reserved_memory) :
-						block_size(blksize), buffer_pool_size(reserved_memory/blksize), last_block_alloted(0)
+BufferedFile::BufferedFile(const char* filepath, size_t blksize, size_t reserved_memory, OpenMode mode) :
+						open_mode(mode), block_size(blksize), buffer_pool_size(reserved_memory/blksize), last_block_alloted(0),
+						last_block_reserved(0), last_block_kept(0), mapping(nullptr), mapping_size(0), blocks_read(0)
 {
-	fd = open(filepath, O_RDWR|O_CREAT, 0755);
+	if(open_mode == READ_WRITE)
+		fd = open(filepath, O_RDWR|O_CREAT, 0755);
+	else
+		fd = open(filepath, O_RDONLY);
+	
+	if(fd == -1)
+		throw std::runtime_error{"Unable to open file"};
 	
-	if(flock(fd, LOCK_EX | LOCK_NB)==-1)
+	// any number of readers may share the file, but never with a writer
+	if(flock(fd, (open_mode == READ_WRITE ? LOCK_EX : LOCK_SH) | LOCK_NB)==-1)
 	{
 		close(fd);
 		throw std::runtime_error{"Unable to lock file"};
 	}
 	
+	struct stat file_stat;
+	if(fstat(fd, &file_stat) == 0)
+		last_block_reserved = (file_stat.st_size / block_size) - 1;
+	
+	if(open_mode == READ_ONLY_MAPPED)
+	{
+		if(last_block_reserved >= 0)
+		{
+			void* addr = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			// without a mapping blocks are simply read into the frames
+			if(addr != MAP_FAILED)
+			{
+				mapping = (char*) addr;
+				mapping_size = file_stat.st_size;
+			}
+		}
+	}
+	
 	frame_pool = new FramePool(this,buffer_pool_size);
 	header = new BufferFrame(this);
 	
 	header->is_valid = true;
 	header->block_number = 0;
+	std::memset(header->data, 0, block_size);
 	pread(fd, header->data, block_size, getblockoffset(0));
 	
 	last_block_alloted = BufferedFrameReader::read<long>(header, 0);
@@ -215,16 +346,26 @@ BufferedFile::BufferedFile(const char* filepath, size_t blksize, size_t reserved
 
 BufferedFile::~BufferedFile()
 {
-	long* last_block_header = (long*) header->data;
-	*last_block_header = last_block_alloted;
-	
-	pwrite(fd, header->data, block_size, getblockoffset(0));
+	if(open_mode == READ_WRITE)
+	{
+		long* last_block_header = (long*) header->data;
+		*last_block_header = last_block_alloted;
+		
+		pwrite(fd, header->data, block_size, getblockoffset(0));
+	}
 
 	delete frame_pool;
 
-	ftruncate(fd, (last_block_alloted+1)*block_size);
+	// drops whatever was preallocated past the last block, except the kept blocks
+	if(open_mode == READ_WRITE)
+	{
+		ftruncate(fd, (std::max(last_block_alloted, last_block_kept)+1)*block_size);
 
-	fsync(fd);
+		fsync(fd);
+	}
+	
+	if(mapping != nullptr)
+		munmap(mapping, mapping_size);
     
 	flock(fd, LOCK_UN | LOCK_NB);
 	close(fd);
@@ -238,59 +379,420 @@ BufferedFile::BufferFrame* BufferedFile::readHeader()
 
 void BufferedFile::writeHeader()
 {
+	if(open_mode != READ_WRITE)
+		return;
+	
 	pwrite(fd, header->data, block_size, getblockoffset(0));
 	header->is_dirty = false;
 }
 
 long BufferedFile::allotBlock()
 {
+	if(open_mode != READ_WRITE)
+		throw std::runtime_error{"File opened read-only"};
+	
 	last_block_alloted++;
+	
+	if(last_block_alloted > last_block_reserved)
+	{
+		long step = std::max((long) (preallocate_bytes / block_size), last_block_alloted / 8);
+		reserveBlocks(last_block_alloted + std::max(step, 1L) - 1);
+	}
+	
 	return last_block_alloted;
 }
 
-//incomplete modularization
+BufferedFile::BufferFrame* BufferedFile::allotFrame()
+{
+	BufferFrame* alloted = assignFrame(allotBlock());
+	std::memset(alloted->data, 0, block_size);
+	return alloted;
+}
+
+void BufferedFile::writeBlocksDirect(long first_block, long count, const void* src) const
+{
+	writeBytesDirect(getblockoffset(first_block), count * block_size, src);
+}
+
+void BufferedFile::readBlocksDirect(long first_block, long count, void* dst) const
+{
+	readBytesDirect(getblockoffset(first_block), count * block_size, dst);
+}
+
+void BufferedFile::writeBytesDirect(off_t offset, size_t size, const void* src) const
+{
+	const char* data = (const char*) src;
+	size_t remaining = size;
+	
+	while(remaining > 0)
+	{
+		ssize_t written = pwrite(fd, data, remaining, offset);
+		if(written <= 0)
+			throw std::runtime_error{"Unable to write blocks"};
+		data += written;
+		offset += written;
+		remaining -= written;
+	}
+}
+
+void BufferedFile::readBytesDirect(off_t offset, size_t size, void* dst) const
+{
+	char* data = (char*) dst;
+	size_t remaining = size;
+	
+	while(remaining > 0)
+	{
+		ssize_t bytes_read = pread(fd, data, remaining, offset);
+		if(bytes_read < 0)
+			throw std::runtime_error{"Unable to read blocks"};
+		if(bytes_read == 0)
+		{
+			std::memset(data, 0, remaining);
+			break;
+		}
+		data += bytes_read;
+		offset += bytes_read;
+		remaining -= bytes_read;
+	}
+}
+
+void BufferedFile::prefetchBlocks(long first_block, long count) const
+{
+	if(count > 0)
+		posix_fadvise(fd, getblockoffset(first_block), getblockoffset(count), POSIX_FADV_WILLNEED);
+}
+
+void BufferedFile::adviseAccess(int advice) const
+{
+	posix_fadvise(fd, 0, 0, advice);
+	
+	// the POSIX_MADV_* values match the POSIX_FADV_* ones up to DONTNEED
+	if(mapping != nullptr && advice <= POSIX_MADV_DONTNEED)
+		posix_madvise(mapping, mapping_size, advice);
+}
+
+void BufferedFile::flush()
+{
+	std::unordered_map<long, BufferFrame*>::iterator iter;
+	for(iter = block_hash.begin(); iter != block_hash.end(); iter++)
+	{
+		if(iter->second->is_dirty)
+			writeBlock(iter->first);
+	}
+}
+
+void BufferedFile::evictBlocks(long first_block, long count)
+{
+	flush();
+	dropFrames(first_block, first_block + count - 1);
+}
+
+void BufferedFile::reserveBlocks(long last_block)
+{
+	if(open_mode != READ_WRITE)
+		throw std::runtime_error{"File opened read-only"};
+	
+	if(last_block <= last_block_reserved)
+		return;
+	
+	// filesystems without fallocate support just keep growing the file on write
+	off_t start = getblockoffset(last_block_reserved + 1);
+	fallocate(fd, 0, start, getblockoffset(last_block + 1) - start);
+	last_block_reserved = last_block;
+}
+
+void BufferedFile::keepBlocks(long last_block)
+{
+	reserveBlocks(last_block);
+	last_block_kept = last_block;
+}
+
+void BufferedFile::trimBlocks()
+{
+	if(open_mode != READ_WRITE)
+		throw std::runtime_error{"File opened read-only"};
+	
+	ftruncate(fd, (last_block_alloted+1)*block_size);
+	last_block_reserved = last_block_alloted;
+	last_block_kept = 0;
+}
+
+void BufferedFile::punchBlocks(long first_block, long count)
+{
+	if(open_mode != READ_WRITE)
+		throw std::runtime_error{"File opened read-only"};
+	
+	if(first_block <= 0 || count <= 0)
+		return;
+	
+	dropFrames(first_block, first_block + count - 1);
+	fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, getblockoffset(first_block), getblockoffset(count));
+}
+
+void BufferedFile::dropFrames(long first_block, long last_block)
+{
+	if(last_block - first_block + 1 <= (long) block_hash.size())
+	{
+		for(long block_number = first_block; block_number <= last_block; block_number++)
+		{
+			std::unordered_map<long, BufferFrame*>::iterator got = block_hash.find(block_number);
+			if(got != block_hash.end())
+			{
+				frame_pool->removeFrame(got->second);
+				block_hash.erase(got);
+			}
+		}
+		return;
+	}
+	
+	std::unordered_map<long, BufferFrame*>::iterator iter = block_hash.begin();
+	while(iter != block_hash.end())
+	{
+		if(iter->first >= first_block && iter->first <= last_block)
+		{
+			frame_pool->removeFrame(iter->second);
+			iter = block_hash.erase(iter);
+		}
+		else
+			iter++;
+	}
+}
+
+BufferedFile::BufferFrame* BufferedFile::assignFrame(long block_number)
+{
+	BufferFrame *alloted;
+	alloted = frame_pool->getNewFrame();
+	
+	if(alloted == frame_pool->getHead())
+		throw std::runtime_error{"All buffer frames are pinned"};
+	
+	if(alloted->is_valid && alloted->is_dirty)
+	{
+		writeBlock(alloted->block_number);
+	}
+	
+	if(alloted->is_valid)
+	{
+		block_hash.erase(alloted->block_number);
+	}
+
+	frame_pool->doAccessUpdate(alloted);
+	
+	alloted->is_valid = true;
+	alloted->is_dirty = false;
+	alloted->block_number = block_number;
+	alloted->data = alloted->buffer;
+	
+	block_hash.insert({block_number, alloted});
+	
+	return alloted;
+}
+
 BufferedFile::BufferFrame* BufferedFile::readBlock(long block_number)
 {
 	std::unordered_map<long, BufferFrame*>::iterator got = block_hash.find(block_number);
 	if(got == block_hash.end())
 	{
-		BufferFrame *alloted;
-		alloted = frame_pool->getNewFrame();
+		BufferFrame *alloted = assignFrame(block_number);
+		
+		if(!mapBlock(alloted))
+		{
+			std::memset(alloted->data, 0, block_size);
+			pread(fd, alloted->data, block_size, getblockoffset(block_number));
+			blocks_read++;
+		}
+		
+		return alloted;
+	}
+	else
+	{
+		frame_pool->doAccessUpdate(got->second);
+		return got->second;
+	}
+}
+
+// points the frame into the file mapping when the block lies inside it
+bool BufferedFile::mapBlock(BufferFrame* frame)
+{
+	if(mapping == nullptr || (size_t) getblockoffset(frame->block_number + 1) > mapping_size)
+		return false;
+	
+	frame->data = mapping + getblockoffset(frame->block_number);
+	return true;
+}
+
+// one preadv for a run of consecutive blocks, anything past end of file reads as zeros
+void BufferedFile::readRun(long first_block, struct iovec* iov, int count)
+{
+	ssize_t bytes_read = preadv(fd, iov, count, getblockoffset(first_block));
+	blocks_read += count;
+	if(bytes_read < 0)
+		bytes_read = 0;
+	
+	for(int i = 0; i < count; i++)
+	{
+		if((size_t) bytes_read < block_size)
+			std::memset((char*)iov[i].iov_base + bytes_read, 0, block_size - bytes_read);
+		bytes_read = ((size_t) bytes_read > block_size) ? (bytes_read - block_size) : 0;
+	}
+}
+
+std::vector<BufferedFile::BufferFrame*> BufferedFile::readBlockRange(long first_block, long count)
+{
+	if(count > buffer_pool_size)
+		throw std::length_error{"BufferedFile::readBlockRange"};
+	
+	std::vector<BufferFrame*> frames(count);
+	std::vector<struct iovec> iov;
+	iov.reserve(count < IOV_MAX ? count : IOV_MAX);
+	long run_start = first_block;
+	
+	for(long i = 0; i < count; i++)
+	{
+		long block_number = first_block + i;
+		std::unordered_map<long, BufferFrame*>::iterator got = block_hash.find(block_number);
 		
-		if(alloted->is_valid && alloted->is_dirty)
+		if(got != block_hash.end())
 		{
-			writeBlock(alloted->block_number);
+			// a cached block breaks the run of misses
+			if(!iov.empty())
+			{
+				readRun(run_start, iov.data(), iov.size());
+				iov.clear();
+			}
+			frame_pool->doAccessUpdate(got->second);
+			got->second->pin();
+			frames[i] = got->second;
+			continue;
 		}
 		
-		if(alloted->is_valid)
+		BufferFrame* alloted;
+		try
+		{
+			alloted = assignFrame(block_number);
+		}
+		catch(...)
 		{
-			block_hash.erase(alloted->block_number);
+			if(!iov.empty())
+				readRun(run_start, iov.data(), iov.size());
+			for(long j = 0; j < i; j++)
+				frames[j]->unpin();
+			throw;
 		}
+		alloted->pin();
+		frames[i] = alloted;
+		
+		if(mapBlock(alloted))
+		{
+			if(!iov.empty())
+			{
+				readRun(run_start, iov.data(), iov.size());
+				iov.clear();
+			}
+			continue;
+		}
+		
+		if(iov.empty())
+			run_start = block_number;
+		
+		struct iovec vec;
+		vec.iov_base = alloted->data;
+		vec.iov_len = block_size;
+		iov.push_back(vec);
+		
+		if(iov.size() == IOV_MAX)
+		{
+			readRun(run_start, iov.data(), iov.size());
+			iov.clear();
+		}
+	}
+	
+	if(!iov.empty())
+		readRun(run_start, iov.data(), iov.size());
+	
+	return frames;
+}
 
-		frame_pool->doAccessUpdate(alloted);
+std::vector<BufferedFile::BufferFrame*> BufferedFile::readBlocks(const std::vector<long>& block_numbers)
+{
+	std::vector<long> sorted(block_numbers);
+	std::sort(sorted.begin(), sorted.end());
+	sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+	
+	if(sorted.size() > (size_t) buffer_pool_size)
+		throw std::length_error{"BufferedFile::readBlocks"};
+	
+	std::vector<BufferFrame*> distinct(sorted.size());
+	std::vector<struct iovec> iov;
+	iov.reserve(sorted.size());
+	
+	// each run is a stretch of consecutive missing blocks: {first block, first iovec, count}
+	struct Run { long first_block; size_t first_iov; int count; };
+	std::vector<Run> runs;
+	
+	for(size_t i = 0; i < sorted.size(); i++)
+	{
+		std::unordered_map<long, BufferFrame*>::iterator got = block_hash.find(sorted[i]);
+		
+		if(got != block_hash.end())
+		{
+			frame_pool->doAccessUpdate(got->second);
+			distinct[i] = got->second;
+			distinct[i]->pin();
+			continue;
+		}
 		
-		//to be modularized yet
-		alloted->is_valid = true;		
-		alloted->block_number = block_number;
-		BufferedFrameWriter::memset(alloted, 0, 0, block_size);
-		alloted->is_dirty = false;
-		pread(fd, alloted->data, block_size, getblockoffset(block_number));
+		BufferFrame* alloted;
+		try
+		{
+			alloted = assignFrame(sorted[i]);
+		}
+		catch(...)
+		{
+			for(size_t r = 0; r < runs.size(); r++)
+				readRun(runs[r].first_block, iov.data() + runs[r].first_iov, runs[r].count);
+			for(size_t j = 0; j < i; j++)
+				distinct[j]->unpin();
+			throw;
+		}
+		alloted->pin();
+		distinct[i] = alloted;
 		
-		block_hash.insert({block_number, alloted});
+		if(mapBlock(alloted))
+			continue;
 		
-		return alloted;
+		struct iovec vec;
+		vec.iov_base = alloted->data;
+		vec.iov_len = block_size;
+		iov.push_back(vec);
+		
+		if(!runs.empty() && runs.back().first_block + runs.back().count == sorted[i] && runs.back().count < IOV_MAX)
+			runs.back().count++;
+		else
+			runs.push_back({sorted[i], iov.size() - 1, 1});
 	}
-	else
+	
+	// one preadv per run on this thread, in increasing disk order
+	for(size_t r = 0; r < runs.size(); r++)
+		readRun(runs[r].first_block, iov.data() + runs[r].first_iov, runs[r].count);
+	
+	std::vector<BufferFrame*> frames(block_numbers.size());
+	for(size_t i = 0; i < block_numbers.size(); i++)
 	{
-		frame_pool->doAccessUpdate(got->second);
-		return got->second;
+		size_t pos = std::lower_bound(sorted.begin(), sorted.end(), block_numbers[i]) - sorted.begin();
+		frames[i] = distinct[pos];
+		frames[i]->pin();
 	}
+	for(size_t i = 0; i < distinct.size(); i++)
+		distinct[i]->unpin();
+	
+	return frames;
 }
 
 //inclomplete modularization updates
 void BufferedFile::writeBlock(long block_number)
 {
-	if(block_number > last_block_alloted)
+	if(block_number > last_block_alloted || open_mode != READ_WRITE)
 		return;
 	
 	std::unordered_map<long, BufferFrame*>::iterator got = block_hash.find(block_number);
@@ -306,15 +808,33 @@ void BufferedFile::deleteBlock(long block_number) {
 	if(block_number == 0)
 		return;
 	
-	std::unordered_map<long, BufferFrame*>::iterator got = block_hash.find(block_number);
-	if(got!=block_hash.end())
-		frame_pool->removeFrame(got->second);
-
+	if(open_mode != READ_WRITE)
+		throw std::runtime_error{"File opened read-only"};
+	
+	if(block_number > last_block_alloted)
+		return;
+	
+	dropFrames(block_number, last_block_alloted);
 	last_block_alloted = block_number - 1;
 	
-	return;
+	// kept blocks hold on to their space. the rest of the freed tail goes back to the
+	// filesystem once it is more than two preallocation steps, so shrinking a block at
+	// a time, as pop_back() does, does not punch a hole at every block boundary
+	long keep = std::max(last_block_alloted, last_block_kept);
+	long step = std::max((long) (preallocate_bytes / block_size), last_block_alloted / 8);
+	if(last_block_reserved - keep > 2 * step)
+	{
+		punchBlocks(keep + 1, last_block_reserved - keep);
+		last_block_reserved = keep;
+	}
 }
 
 typedef BufferedFile::BufferFrame BufferFrame;
 typedef BufferedFile::BufferedFrameWriter BufferedFrameWriter;
 typedef BufferedFile::BufferedFrameReader BufferedFrameReader;
+
+#if defined(__cpp_impl_coroutine)
+#include "block_async.h"
+#endif
+
+#endif
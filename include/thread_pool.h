@@ -0,0 +1,268 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* work-stealing pool for a fixed batch of numbered tasks
+ *
+ * every worker starts with its own contiguous share of the task numbers
+ * and takes them from the front, in order, so a worker walking file
+ * chunks reads sequentially. a worker that runs dry steals from the back
+ * of another worker's share, the part the owner would get to last.
+ * the worker threads are started once and wait between batches.
+ */
+
+class WorkStealingPool
+{
+	struct TaskQueue {
+		std::mutex lock;
+		std::deque<long> tasks;
+	};
+
+	int num_threads;
+	// the workers past the calling thread, started once and kept for every batch
+	std::vector<std::thread> threads;
+
+	// the batch being run, guarded by lock
+	std::mutex lock;
+	std::condition_variable batch_ready, batch_done;
+	std::function<void(long, int)> task;
+	std::vector< std::unique_ptr<TaskQueue> > queues;
+	int workers;
+	long batch;
+	int busy;
+	bool stopping;
+
+	std::atomic<bool> failed;
+	std::exception_ptr error;
+	std::mutex error_lock;
+	// one batch at a time
+	std::mutex run_lock;
+
+	void workerThread(int w);
+	void work(int w);
+
+public:
+	// 0 threads means one per hardware thread
+	WorkStealingPool(int threads = 0);
+	~WorkStealingPool();
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator= (const WorkStealingPool&) = delete;
+
+	int size() const { return num_threads; }
+
+	// calls task(t, worker) for every t in [0, num_tasks) and returns once all are done.
+	// the first exception thrown by a task stops the batch and is rethrown here.
+	// the calling thread works on the batch as worker 0.
+	template <typename Task>
+	void run(long num_tasks, Task task);
+};
+
+inline WorkStealingPool::WorkStealingPool(int num) : num_threads(num), workers(0), batch(0), busy(0), stopping(false), failed(false)
+{
+	if(num_threads <= 0)
+		num_threads = std::thread::hardware_concurrency();
+	if(num_threads <= 0)
+		num_threads = 1;
+
+	for(int w = 1; w < num_threads; w++)
+		threads.push_back(std::thread(&WorkStealingPool::workerThread, this, w));
+}
+
+inline WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	batch_ready.notify_all();
+	for(size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+// waits for every batch that has work for worker w
+inline void WorkStealingPool::workerThread(int w)
+{
+	long seen = 0;
+	std::unique_lock<std::mutex> guard(lock);
+	while(true)
+	{
+		batch_ready.wait(guard, [&]() { return stopping || batch != seen; });
+		if(stopping)
+			return;
+		seen = batch;
+		if(w >= workers)
+			continue;
+
+		guard.unlock();
+		work(w);
+		guard.lock();
+		if(--busy == 0)
+			batch_done.notify_one();
+	}
+}
+
+inline void WorkStealingPool::work(int w)
+{
+	while(!failed.load())
+	{
+		long t = -1;
+		{
+			std::lock_guard<std::mutex> guard(queues[w]->lock);
+			if(!queues[w]->tasks.empty())
+			{
+				t = queues[w]->tasks.front();
+				queues[w]->tasks.pop_front();
+			}
+		}
+
+		// no task is ever added, so finding every queue empty means the batch is done
+		for(int v = 1; t < 0 && v < workers; v++)
+		{
+			TaskQueue& victim = *queues[(w + v) % workers];
+			std::lock_guard<std::mutex> guard(victim.lock);
+			if(!victim.tasks.empty())
+			{
+				t = victim.tasks.back();
+				victim.tasks.pop_back();
+			}
+		}
+
+		if(t < 0)
+			return;
+
+		try
+		{
+			task(t, w);
+		}
+		catch(...)
+		{
+			std::lock_guard<std::mutex> guard(error_lock);
+			if(!error)
+				error = std::current_exception();
+			failed = true;
+		}
+	}
+}
+
+template <typename Task>
+void WorkStealingPool::run(long num_tasks, Task fn)
+{
+	if(num_tasks <= 0)
+		return;
+
+	std::lock_guard<std::mutex> running(run_lock);
+
+	int batch_workers = (num_tasks < num_threads) ? (int) num_tasks : num_threads;
+	std::vector< std::unique_ptr<TaskQueue> > batch_queues;
+	for(int w = 0; w < batch_workers; w++)
+	{
+		batch_queues.push_back(std::unique_ptr<TaskQueue>(new TaskQueue()));
+		for(long t = (num_tasks * w) / batch_workers; t < (num_tasks * (w + 1)) / batch_workers; t++)
+			batch_queues[w]->tasks.push_back(t);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		task = fn;
+		queues.swap(batch_queues);
+		workers = batch_workers;
+		busy = batch_workers - 1;
+		failed = false;
+		error = nullptr;
+		batch++;
+	}
+	batch_ready.notify_all();
+
+	work(0);
+
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		batch_done.wait(guard, [&]() { return busy == 0; });
+		task = nullptr;
+	}
+
+	if(error)
+		std::rethrow_exception(error);
+}
+
+/* one thread that runs the jobs handed to it in order
+ *
+ * meant for I/O that overlaps with the caller: a stream submits the read
+ * or write of a buffer and keeps working on another one, without paying
+ * for a new thread per buffer. queued jobs still run before the thread
+ * is joined on destruction.
+ */
+
+class BackgroundWorker
+{
+	std::mutex lock;
+	std::condition_variable ready;
+	std::deque< std::packaged_task<void()> > jobs;
+	bool stopping;
+	// last, so it starts once everything it uses is set up
+	std::thread thread;
+
+	void loop();
+
+public:
+	BackgroundWorker() : stopping(false), thread(&BackgroundWorker::loop, this) {}
+	~BackgroundWorker();
+	BackgroundWorker(const BackgroundWorker&) = delete;
+	BackgroundWorker& operator= (const BackgroundWorker&) = delete;
+
+	// the future gets the job's exception, if it throws one
+	template <typename Job>
+	std::future<void> submit(Job job);
+};
+
+inline BackgroundWorker::~BackgroundWorker()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	ready.notify_one();
+	thread.join();
+}
+
+inline void BackgroundWorker::loop()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	while(true)
+	{
+		ready.wait(guard, [&]() { return stopping || !jobs.empty(); });
+		if(jobs.empty())
+			return;
+
+		std::packaged_task<void()> job(std::move(jobs.front()));
+		jobs.pop_front();
+		guard.unlock();
+		job();
+		guard.lock();
+	}
+}
+
+template <typename Job>
+std::future<void> BackgroundWorker::submit(Job job)
+{
+	std::packaged_task<void()> task(job);
+	std::future<void> done = task.get_future();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		jobs.push_back(std::move(task));
+	}
+	ready.notify_one();
+	return done;
+}
+
+#endif
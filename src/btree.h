@@ -691,10 +691,13 @@ private:
 	}
 
 public:
-	BTree(const char* pathname, size_type _blocksize = 4096) : blocksize(_blocksize), sz(0) {
-		buffered_file_internal = new BufferedFile(pathname, blocksize);
+	// open with BufferedFile::READ_ONLY to share the tree with other reading processes
+	BTree(const char* pathname, size_type _blocksize = 4096,
+		BufferedFile::OpenMode mode = BufferedFile::READ_WRITE
+	) : blocksize(_blocksize), sz(0) {
+		buffered_file_internal = new BufferedFile(pathname, blocksize, 1048576, mode);
 
-		buffered_file_data = new BufferedFile("data_file", sizeof(V));
+		buffered_file_data = new BufferedFile("data_file", sizeof(V), 1048576, mode);
 
 		M = calculateM(blocksize);
 
@@ -754,6 +757,11 @@ public:
 		return curr;
 	}
 
+	// blocks read from the tree's files so far
+	long blocks_read() const {
+		return buffered_file_internal->getBlocksRead() + buffered_file_data->getBlocksRead();
+	}
+
 	blocknum_t getRootBlockNo() {
 		return this->root_block_num;
 	}
@@ -785,7 +793,7 @@ public:
 	friend class BTree;
 	private:
 		TreeLeafNode<K, V, CompareFn>* head, tail, curr;
-		V* value;
+		const V* value;
 		BufferedFile* data_file;
 
 		// for iterating in 'curr'
@@ -807,7 +815,7 @@ public:
 				curr->getBlockOffsetPairs(addrList);
 				block_iter = addrList.begin();
 
-				value = BufferedFrameReader::readPtr<V>(
+				value = (const V*) BufferedFrameReader::readRawData(
 					data_file->readBlock((*block_iter).block_number),
 					(*block_iter).offset
 				);
@@ -886,7 +894,7 @@ typename BTree<K, V, CompareFn>::iterator& BTree<K, V, CompareFn>::iterator::ope
 		block_iter++;
 	}
 
-	value = BufferedFrameReader::readPtr<V>(
+	value = (const V*) BufferedFrameReader::readRawData(
 		data_file->readBlock(
 			(*block_iter).block_number
 		),
@@ -931,7 +939,7 @@ typename BTree<K, V, CompareFn>::iterator& BTree<K, V, CompareFn>::iterator::ope
 		block_iter--;
 	}
 
-	value = BufferedFrameReader::readPtr<V>(
+	value = (const V*) BufferedFrameReader::readRawData(
 		data_file->readBlock(
 			(*block_iter).block_number
 		),
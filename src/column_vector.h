@@ -0,0 +1,241 @@
+#ifndef COLUMN_VECTOR_H
+#define COLUMN_VECTOR_H
+
+#include "vector.h"
+#include <memory>
+#include <string>
+#include <tuple>
+
+/* struct-of-arrays external vector: one vector<F> per field
+ *
+ * column I of column_vector<Fields...>("path", ...) is an ordinary
+ * vector<F> in the file path.I, so a scan that needs one field reads only
+ * that field's blocks. every column has the same length. column<I>() hands
+ * out the column itself, with its block spans and vectorised kernels:
+ *
+ *	column_vector<long, int, double> trades("trades", 4096);
+ *	trades.push_back(id, qty, price);
+ *	double total = trades.column<2>().sum();
+ *	trades.scan<1, 2>([](int qty, double price) { ... });
+ */
+
+template <size_t... I>
+struct column_indices {};
+
+template <size_t N, size_t... I>
+struct make_column_indices : make_column_indices<N - 1, N - 1, I...> {};
+
+template <size_t... I>
+struct make_column_indices<0, I...> { typedef column_indices<I...> type; };
+
+template <typename... Fields>
+class column_vector
+{
+public:
+	typedef long long int size_type;
+	typedef std::tuple<Fields...> row_type;
+
+	template <size_t I>
+	using field_type = typename std::tuple_element<I, row_type>::type;
+
+	static const size_t num_columns = sizeof...(Fields);
+
+private:
+	typedef typename make_column_indices<sizeof...(Fields)>::type all_columns;
+
+	std::tuple< std::unique_ptr< vector<Fields> >... > columns;
+
+	static std::string columnPath(const char* pathname, size_t column) { return std::string(pathname) + "." + std::to_string(column); }
+
+	template <size_t... K>
+	void open(const char* pathname, size_type blocksize, const vector_options& options, column_indices<K...>);
+	template <size_t... K>
+	void pushRow(const Fields&... values, column_indices<K...>);
+	template <size_t... K>
+	void appendRows(size_type n, const Fields*... values, column_indices<K...>);
+	template <size_t... K>
+	row_type readRow(size_type n, column_indices<K...>);
+	template <typename ColumnFn, size_t... K>
+	void forEachColumn(ColumnFn fn, column_indices<K...>);
+	// brings every column back to n elements after a change failed partway
+	void rollBack(size_type n);
+	template <typename Function, size_t... I, size_t... K>
+	void scanColumns(Function fn, column_indices<I...>, column_indices<K...>);
+
+	// the per-column operations for forEachColumn
+	struct pop_back_column {
+		template <typename Column>
+		void operator() (Column& column) const { column.pop_back(); }
+	};
+	struct clear_column {
+		template <typename Column>
+		void operator() (Column& column) const { column.clear(); }
+	};
+	struct resize_column {
+		size_type n;
+		resize_column(size_type rows) : n(rows) {}
+		template <typename Column>
+		void operator() (Column& column) const { column.resize(n); }
+	};
+	struct check_column {
+		size_type n;
+		check_column(size_type rows) : n(rows) {}
+		template <typename Column>
+		void operator() (Column& column) const
+		{
+			if(column.size() != n)
+				throw std::runtime_error{"Columns of different length"};
+		}
+	};
+
+public:
+	// every column gets its own buffer pool, an automatic pool_memory is shared out between them
+	column_vector(const char* pathname, size_type blocksize, const vector_options& options = vector_options());
+
+	size_type size() { return std::get<0>(columns)->size(); }
+
+	// column I as an ordinary vector. changing its length breaks the table, use the
+	// column_vector members for that.
+	template <size_t I>
+	vector< field_type<I> >& column() { return *std::get<I>(columns); }
+
+	// a push, append or resize that throws partway is undone on the columns it got to,
+	// so they stay the same length
+	void push_back(const Fields&... values) { pushRow(values..., all_columns()); }
+	void push_back(const row_type& row) { push_back_row(row, all_columns()); }
+	// n rows given as one array per column
+	void append(size_type n, const Fields*... values) { appendRows(n, values..., all_columns()); }
+	void pop_back() { forEachColumn(pop_back_column(), all_columns()); }
+	void clear() { forEachColumn(clear_column(), all_columns()); }
+	void resize(size_type n);
+
+	// reads one element of every column
+	row_type row(size_type n) { return readRow(n, all_columns()); }
+
+	// calls fn(column<I>()[n]...) for every row n, reading only columns I...,
+	// each through its own stream_reader
+	template <size_t... I, typename Function>
+	void scan(Function fn) { scanColumns(fn, column_indices<I...>(), typename make_column_indices<sizeof...(I)>::type()); }
+
+private:
+	template <size_t... K>
+	void push_back_row(const row_type& row, column_indices<K...>) { push_back(std::get<K>(row)...); }
+};
+
+template <typename... Fields>
+const size_t column_vector<Fields...>::num_columns;
+
+template <typename... Fields>
+column_vector<Fields...>::column_vector(const char* pathname, size_type blocksize, const vector_options& options)
+{
+	vector_options column_options = options;
+	if(column_options.pool_memory == 0)
+		column_options.pool_memory = std::max(options.poolMemory(blocksize) / num_columns, (size_t) blocksize * 10);
+
+	open(pathname, blocksize, column_options, all_columns());
+
+	// a crash between the columns' headers being written can leave them uneven
+	forEachColumn(check_column(size()), all_columns());
+}
+
+template <typename... Fields>
+void column_vector<Fields...>::resize(size_type n)
+{
+	size_type rows = size();
+	try
+	{
+		forEachColumn(resize_column(n), all_columns());
+	}
+	catch(...)
+	{
+		rollBack(rows);
+		throw;
+	}
+}
+
+template <typename... Fields>
+void column_vector<Fields...>::rollBack(size_type n)
+{
+	// the original error is the one worth reporting
+	try
+	{
+		forEachColumn(resize_column(n), all_columns());
+	}
+	catch(...)
+	{
+	}
+}
+
+template <typename... Fields>
+template <size_t... K>
+void column_vector<Fields...>::open(const char* pathname, size_type blocksize, const vector_options& options, column_indices<K...>)
+{
+	int opened[] = { (std::get<K>(columns).reset(new vector< field_type<K> >(columnPath(pathname, K).c_str(), blocksize, options)), 0)... };
+	(void) opened;
+}
+
+template <typename... Fields>
+template <size_t... K>
+void column_vector<Fields...>::pushRow(const Fields&... values, column_indices<K...>)
+{
+	size_type rows = size();
+	try
+	{
+		int pushed[] = { (std::get<K>(columns)->push_back(values), 0)... };
+		(void) pushed;
+	}
+	catch(...)
+	{
+		rollBack(rows);
+		throw;
+	}
+}
+
+template <typename... Fields>
+template <size_t... K>
+void column_vector<Fields...>::appendRows(size_type n, const Fields*... values, column_indices<K...>)
+{
+	size_type rows = size();
+	try
+	{
+		int appended[] = { (std::get<K>(columns)->append(values, n), 0)... };
+		(void) appended;
+	}
+	catch(...)
+	{
+		rollBack(rows);
+		throw;
+	}
+}
+
+template <typename... Fields>
+template <size_t... K>
+typename column_vector<Fields...>::row_type column_vector<Fields...>::readRow(size_type n, column_indices<K...>)
+{
+	return row_type((*std::get<K>(columns))[n]...);
+}
+
+template <typename... Fields>
+template <typename ColumnFn, size_t... K>
+void column_vector<Fields...>::forEachColumn(ColumnFn fn, column_indices<K...>)
+{
+	int done[] = { (fn(*std::get<K>(columns)), 0)... };
+	(void) done;
+}
+
+template <typename... Fields>
+template <typename Function, size_t... I, size_t... K>
+void column_vector<Fields...>::scanColumns(Function fn, column_indices<I...>, column_indices<K...>)
+{
+	std::tuple< std::unique_ptr< typename vector< field_type<I> >::stream_reader >... > readers(
+		std::unique_ptr< typename vector< field_type<I> >::stream_reader >(new typename vector< field_type<I> >::stream_reader(column<I>()))...);
+
+	for(size_type n = size(); n > 0; n--)
+	{
+		fn(**std::get<K>(readers)...);
+		int advanced[] = { (++(*std::get<K>(readers)), 0)... };
+		(void) advanced;
+	}
+}
+
+#endif
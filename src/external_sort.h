@@ -0,0 +1,364 @@
+#ifndef EXTERNAL_SORT_H
+#define EXTERNAL_SORT_H
+
+#include "vector.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* external merge sort for vector<T>
+ *
+ * run formation reads memory_budget bytes of the vector at a time, sorts
+ * them in parallel and writes them out as a run to an unlinked temporary
+ * file. the runs are then merged k at a time through a loser tree. every
+ * run is read through two buffers, one being merged while the next is
+ * read by the merge's I/O thread, and merged output goes out in buffer-sized
+ * sequential writes. as long as all runs fit in one merge that is two
+ * passes over the data: one to form the runs, one to merge them.
+ */
+
+struct external_sort_stats {
+	long long bytes_read;
+	long long bytes_written;
+	int passes;         // run formation counts as the first one
+	long runs;          // runs formed in the first pass
+};
+
+// a sorted run in a temporary file
+struct SortRun {
+	int fd;
+	long long count;
+
+	SortRun(const std::string& tmp_dir) : fd(-1), count(0)
+	{
+		std::string path = tmp_dir + "/extsortXXXXXX";
+		std::vector<char> name(path.begin(), path.end());
+		name.push_back('\0');
+
+		fd = mkstemp(name.data());
+		if(fd == -1)
+			throw std::runtime_error{"Unable to create sort run file"};
+		unlink(name.data());
+	}
+	~SortRun() { close(fd); }
+};
+
+inline void sortWriteAll(int fd, const char* data, size_t size, off_t offset)
+{
+	while(size > 0)
+	{
+		ssize_t written = pwrite(fd, data, size, offset);
+		if(written <= 0)
+			throw std::runtime_error{"Unable to write sort run"};
+		data += written;
+		offset += written;
+		size -= written;
+	}
+}
+
+inline size_t sortReadAll(int fd, char* data, size_t size, off_t offset)
+{
+	size_t total = 0;
+	while(total < size)
+	{
+		ssize_t bytes_read = pread(fd, data + total, size - total, offset + total);
+		if(bytes_read < 0)
+			throw std::runtime_error{"Unable to read sort run"};
+		if(bytes_read == 0)
+			break;
+		total += bytes_read;
+	}
+	return total;
+}
+
+// streams a run through two buffers, the next one is read on io while the current one is merged
+template <typename T>
+class SortRunReader
+{
+	int fd;
+	BackgroundWorker& io;
+	off_t next_offset;
+	long long unread;
+	std::vector<T> buffers[2];
+	int current;
+	size_t pos, count;
+	// elements the pending read got, set on io
+	size_t fetched;
+	std::future<void> pending;
+
+	void fetch(int buffer)
+	{
+		size_t n = std::min((long long) buffers[buffer].size(), unread);
+		char* dst = (char*) buffers[buffer].data();
+		int file = fd;
+		off_t offset = next_offset;
+
+		next_offset += n * sizeof(T);
+		unread -= n;
+		size_t* result = &fetched;
+		pending = io.submit([file, dst, n, offset, result]() {
+			*result = sortReadAll(file, dst, n * sizeof(T), offset) / sizeof(T);
+		});
+	}
+
+	void swapIn()
+	{
+		count = 0;
+		if(pending.valid())
+		{
+			pending.get();
+			count = fetched;
+		}
+		current ^= 1;
+		pos = 0;
+		if(unread > 0)
+			fetch(current ^ 1);
+	}
+
+public:
+	SortRunReader(const SortRun& run, size_t buffer_elems, BackgroundWorker& worker) : fd(run.fd), io(worker), next_offset(0), unread(run.count),
+		current(1), pos(0), count(0), fetched(0)
+	{
+		buffers[0].resize(buffer_elems);
+		buffers[1].resize(buffer_elems);
+		if(unread > 0)
+			fetch(0);
+		swapIn();
+	}
+	~SortRunReader() { if(pending.valid()) pending.wait(); }
+
+	bool empty() const { return pos >= count; }
+	const T& head() const { return buffers[current][pos]; }
+	void advance() { if(++pos == count) swapIn(); }
+};
+
+// k-way merge: tree[0] is the current winner, tree[1..k-1] hold the loser of every match
+template <typename T, typename Compare>
+class LoserTree
+{
+	std::vector< std::unique_ptr< SortRunReader<T> > >& sources;
+	std::vector<int> tree;
+	int k;
+	Compare comp;
+
+	// an exhausted source loses to everything, ties go to the lower source for stability
+	bool beats(int a, int b)
+	{
+		if(sources[b]->empty()) return true;
+		if(sources[a]->empty()) return false;
+		if(comp(sources[a]->head(), sources[b]->head())) return true;
+		if(comp(sources[b]->head(), sources[a]->head())) return false;
+		return a < b;
+	}
+
+	void replay(int winner)
+	{
+		for(int node = (winner + k) / 2; node > 0; node /= 2)
+		{
+			if(beats(tree[node], winner))
+				std::swap(tree[node], winner);
+		}
+		tree[0] = winner;
+	}
+
+public:
+	LoserTree(std::vector< std::unique_ptr< SortRunReader<T> > >& runs, Compare c) : sources(runs), tree(runs.size(), -1), k(runs.size()), comp(c)
+	{
+		// every internal node keeps the first player to reach it, the second plays the match
+		for(int s = 0; s < k; s++)
+		{
+			int winner = s;
+			int node = (s + k) / 2;
+			while(node > 0 && tree[node] != -1)
+			{
+				if(beats(tree[node], winner))
+					std::swap(tree[node], winner);
+				node /= 2;
+			}
+			tree[node] = winner;
+		}
+	}
+
+	bool empty() { return sources[tree[0]]->empty(); }
+	const T& top() { return sources[tree[0]]->head(); }
+	void pop()
+	{
+		sources[tree[0]]->advance();
+		replay(tree[0]);
+	}
+};
+
+template <typename T, typename Compare>
+void parallelSort(T* data, size_t n, Compare comp, WorkStealingPool& pool)
+{
+	size_t parts = pool.size();
+	if(parts <= 1 || n < 65536)
+	{
+		std::sort(data, data + n, comp);
+		return;
+	}
+
+	std::vector<size_t> bounds(parts + 1);
+	for(size_t i = 0; i <= parts; i++)
+		bounds[i] = (n * i) / parts;
+
+	pool.run(parts, [&](long part, int) {
+		std::sort(data + bounds[part], data + bounds[part + 1], comp);
+	});
+
+	// pairwise merges, each round halves the number of sorted slices
+	for(size_t width = 1; width < parts; width *= 2)
+	{
+		long merges = (parts + 2 * width - 1) / (2 * width);
+		pool.run(merges, [&](long m, int) {
+			size_t lo = m * 2 * width;
+			size_t mid = std::min(lo + width, parts);
+			size_t hi = std::min(lo + 2 * width, parts);
+			if(mid < hi)
+				std::inplace_merge(data + bounds[lo], data + bounds[mid], data + bounds[hi], comp);
+		});
+	}
+}
+
+// merges the runs into out_run, or into vec when out_run is null
+template <typename T, size_t BlockSize, typename Compare>
+void mergeRuns(std::vector< std::unique_ptr<SortRun> >& runs, size_t first, size_t count, Compare comp,
+	size_t buffer_elems, SortRun* out_run, vector<T, BlockSize>* vec, external_sort_stats& stats)
+{
+	// one thread reads ahead for every run of the merge, the readers go before it
+	BackgroundWorker io;
+	std::vector< std::unique_ptr< SortRunReader<T> > > readers;
+	for(size_t r = first; r < first + count; r++)
+	{
+		readers.push_back(std::unique_ptr< SortRunReader<T> >(new SortRunReader<T>(*runs[r], buffer_elems, io)));
+		stats.bytes_read += runs[r]->count * sizeof(T);
+	}
+
+	LoserTree<T, Compare> tree(readers, comp);
+	std::vector<T> out(buffer_elems);
+	size_t filled = 0;
+	off_t offset = 0;
+
+	auto drain = [&]() {
+		if(out_run != nullptr)
+		{
+			sortWriteAll(out_run->fd, (const char*) out.data(), filled * sizeof(T), offset);
+			offset += filled * sizeof(T);
+			out_run->count += filled;
+		}
+		else
+			vec->append(out.data(), filled);
+		stats.bytes_written += filled * sizeof(T);
+		filled = 0;
+	};
+
+	while(!tree.empty())
+	{
+		out[filled++] = tree.top();
+		tree.pop();
+		if(filled == out.size())
+			drain();
+	}
+	if(filled > 0)
+		drain();
+}
+
+// sorts vec by comp using at most about memory_budget bytes of memory.
+// the temporary runs go to tmp_dir, threads = 0 uses every hardware thread.
+template <typename T, size_t BlockSize, typename Compare>
+external_sort_stats external_sort(vector<T, BlockSize>& vec, Compare comp, size_t memory_budget,
+	const char* tmp_dir = ".", int threads = 0)
+{
+	external_sort_stats stats = {0, 0, 0, 0};
+	typename vector<T, BlockSize>::size_type n = vec.size();
+	if(n == 0)
+		return stats;
+
+	size_t run_elems = std::max(memory_budget / sizeof(T), (size_t) vec.elements_per_block());
+	std::vector<T> buffer((size_t) std::min((typename vector<T, BlockSize>::size_type) run_elems, n));
+	std::vector< std::unique_ptr<SortRun> > runs;
+	// one set of worker threads sorts every run
+	WorkStealingPool pool(threads);
+
+	// pass 1: sorted runs of up to run_elems elements
+	size_t filled = 0;
+	auto spill = [&]() {
+		parallelSort(buffer.data(), filled, comp, pool);
+		runs.push_back(std::unique_ptr<SortRun>(new SortRun(tmp_dir)));
+		sortWriteAll(runs.back()->fd, (const char*) buffer.data(), filled * sizeof(T), 0);
+		runs.back()->count = filled;
+		stats.bytes_written += filled * sizeof(T);
+		filled = 0;
+	};
+
+	if((typename vector<T, BlockSize>::size_type) buffer.size() == n)
+	{
+		// fits in memory, sort in place and write straight back
+		for(auto span : vec.cblocks())
+		{
+			std::copy(span.begin(), span.end(), buffer.data() + filled);
+			filled += span.size();
+		}
+		stats.bytes_read += n * sizeof(T);
+		parallelSort(buffer.data(), filled, comp, pool);
+		vec.assign(buffer.data(), filled);
+		stats.bytes_written += n * sizeof(T);
+		stats.passes = 1;
+		stats.runs = 1;
+		return stats;
+	}
+
+	for(auto span : vec.cblocks())
+	{
+		const T* data = span.data();
+		size_t left = span.size();
+		while(left > 0)
+		{
+			size_t take = std::min(left, buffer.size() - filled);
+			std::copy(data, data + take, buffer.data() + filled);
+			filled += take;
+			data += take;
+			left -= take;
+			if(filled == buffer.size())
+				spill();
+		}
+	}
+	if(filled > 0)
+		spill();
+	std::vector<T>().swap(buffer);
+
+	stats.bytes_read += n * sizeof(T);
+	stats.passes = 1;
+	stats.runs = runs.size();
+
+	// every run being merged, and the output, gets a double buffer out of the budget
+	const size_t min_buffer_elems = std::max((size_t) 65536 / sizeof(T), (size_t) 1);
+	size_t max_fan_in = std::max(memory_budget / (2 * sizeof(T) * min_buffer_elems), (size_t) 3) - 1;
+
+	// merge passes until one merge can take every run
+	while(runs.size() > max_fan_in)
+	{
+		std::vector< std::unique_ptr<SortRun> > merged;
+		size_t buffer_elems = std::max(memory_budget / (sizeof(T) * 2 * (max_fan_in + 1)), min_buffer_elems);
+		for(size_t first = 0; first < runs.size(); first += max_fan_in)
+		{
+			size_t count = std::min(max_fan_in, runs.size() - first);
+			merged.push_back(std::unique_ptr<SortRun>(new SortRun(tmp_dir)));
+			mergeRuns<T, BlockSize, Compare>(runs, first, count, comp, buffer_elems, merged.back().get(), nullptr, stats);
+		}
+		runs.swap(merged);
+		stats.passes++;
+	}
+
+	size_t buffer_elems = std::max(memory_budget / (sizeof(T) * 2 * (runs.size() + 1)), min_buffer_elems);
+	vec.clear();
+	mergeRuns<T, BlockSize, Compare>(runs, 0, runs.size(), comp, buffer_elems, nullptr, &vec, stats);
+	stats.passes++;
+
+	return stats;
+}
+
+#endif
@@ -0,0 +1,631 @@
+#ifndef INDEXED_VECTOR_H
+#define INDEXED_VECTOR_H
+
+#include "buffer.h"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/* a vector whose logical blocks are mapped to physical blocks
+ *
+ * vector<T> keeps element n at a fixed place in the file, so an insert or
+ * erase in the middle shifts every block after it. here the file is a heap
+ * of blocks, each possibly only partly full, and a block map lists them in
+ * logical order together with their element counts. an insert touches the
+ * block it lands in, and one new block when that one is full. an erase
+ * touches the blocks it empties or trims. a counted index over the map
+ * (a Fenwick tree of the block counts) finds the block holding element n
+ * in O(log n).
+ *
+ * the block map lives in memory and is written to <path>.map on close.
+ * the file is rewritten densely by compact(), which also runs on its own
+ * once blocks are on average less than compact_fill_percent full.
+ */
+
+template <typename T>
+class indexed_vector
+{
+public:
+	typedef long long int size_type;
+private:
+	struct block_entry {
+		long physical;
+		size_type count;
+	};
+
+	const size_t block_size;
+	const size_t element_size;
+	const size_t num_elements_per_block;
+	BufferedFile* buffered_file;
+	std::string map_path;
+	size_type sz;
+	bool closed;
+
+	// logical order, block_map[i] holds the elements after those of block_map[0..i-1]
+	std::vector<block_entry> block_map;
+	// Fenwick tree over the counts in block_map, 1-based
+	std::vector<size_type> count_index;
+	// physical blocks given back by erase, reused before the file grows
+	std::vector<long> free_blocks;
+
+	void rebuildIndex();
+	void addCount(long entry, size_type delta);
+	// the entry holding element n, offset is set to n's place in that block
+	long locate(size_type n, size_type& offset) const;
+	BufferFrame* newBlock(long& physical);
+	void freeBlock(long physical);
+	// folds the block after entry into it when both fit in one block
+	bool mergeNext(long entry);
+	void loadMap();
+	void saveMap();
+
+public:
+	// compact() runs by itself once the blocks are on average less full than this
+	static const int compact_fill_percent = 50;
+	// blocks handled per direct write while compacting
+	static const long compact_chunk_blocks = 64;
+
+	indexed_vector(const char* pathname, size_type blocksize, BufferedFile::OpenMode mode = BufferedFile::READ_WRITE);
+	// closes the vector if close() was not called, any error is swallowed
+	~indexed_vector();
+	// writes the block map and the header, and throws if they cannot be written.
+	// the vector is not used after it.
+	void close();
+
+	size_type size() { return sz; }
+	size_type elements_per_block() const { return num_elements_per_block; }
+	long num_blocks() const { return block_map.size(); }
+	// share of the blocks' room that holds elements, 1 right after compact()
+	double fill_factor() const { return block_map.empty() ? 1.0 : (double) sz / ((double) block_map.size() * num_elements_per_block); }
+
+	void push_back(const T& elem) { insert(sz, elem); }
+	void pop_back();
+
+	void insert(size_type pos, const T& elem);
+	template <typename InputIterator>
+	void insert(size_type pos, InputIterator first, InputIterator last);
+
+	// removes elements first to last, both included, like vector<T>::erase
+	void erase(size_type first, size_type last);
+	void clear();
+
+	// rewrites the elements into full blocks, in logical order, at the front of the file
+	void compact();
+
+	// throws on a read-only vector, whose elements are read through the const overload
+	T& operator[] (size_type n);
+	const T& operator[] (size_type n) const;
+};
+
+template <typename T>
+const long indexed_vector<T>::compact_chunk_blocks;
+
+template <typename T>
+indexed_vector<T>::indexed_vector(const char* pathname, size_type blocksize, BufferedFile::OpenMode mode) : block_size(blocksize),
+	element_size(sizeof(T)), num_elements_per_block(blocksize/(sizeof(T))), map_path(std::string(pathname) + ".map"), sz(0), closed(false) {
+	buffered_file = new BufferedFile(pathname, block_size, block_size*10, mode);
+
+	BufferFrame* header = buffered_file->readHeader();
+	sz = BufferedFrameReader::read<size_type>(header, sizeof(long));
+
+	loadMap();
+}
+
+template <typename T>
+indexed_vector<T>::~indexed_vector()
+{
+	try
+	{
+		close();
+	}
+	catch(...)
+	{
+	}
+
+	delete buffered_file;
+}
+
+template <typename T>
+void indexed_vector<T>::close()
+{
+	if(closed)
+		return;
+
+	if(!buffered_file->isReadOnly())
+	{
+		saveMap();
+		BufferedFrameWriter::write<size_type>(buffered_file->readHeader(), sizeof(long), sz);
+		buffered_file->writeHeader();
+	}
+	closed = true;
+}
+
+template <typename T>
+void indexed_vector<T>::loadMap()
+{
+	block_map.clear();
+	free_blocks.clear();
+
+	int fd = open(map_path.c_str(), O_RDONLY);
+	if(fd == -1)
+	{
+		if(sz != 0)
+			throw std::runtime_error{"Block map missing"};
+		rebuildIndex();
+		return;
+	}
+
+	// entries, free blocks, then the entries as (physical, count) and the free block numbers
+	long counts[2] = {0, 0};
+	bool valid = pread(fd, counts, sizeof(counts), 0) == sizeof(counts) && counts[0] >= 0 && counts[1] >= 0;
+	std::vector<long> raw(valid ? 2 * counts[0] + counts[1] : 0);
+	if(valid && !raw.empty())
+		valid = pread(fd, raw.data(), raw.size() * sizeof(long), sizeof(counts)) == (ssize_t) (raw.size() * sizeof(long));
+	::close(fd);
+
+	size_type total = 0;
+	for(long i = 0; valid && i < counts[0]; i++)
+	{
+		block_entry entry = { raw[2 * i], raw[2 * i + 1] };
+		block_map.push_back(entry);
+		total += entry.count;
+	}
+	for(long i = 0; valid && i < counts[1]; i++)
+		free_blocks.push_back(raw[2 * counts[0] + i]);
+
+	if(!valid || total != sz)
+		throw std::runtime_error{"Block map does not match the file"};
+
+	rebuildIndex();
+}
+
+template <typename T>
+void indexed_vector<T>::saveMap()
+{
+	std::vector<long> raw;
+	raw.push_back(block_map.size());
+	raw.push_back(free_blocks.size());
+	for(size_t i = 0; i < block_map.size(); i++)
+	{
+		raw.push_back(block_map[i].physical);
+		raw.push_back(block_map[i].count);
+	}
+	raw.insert(raw.end(), free_blocks.begin(), free_blocks.end());
+
+	int fd = open(map_path.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0755);
+	if(fd == -1)
+		throw std::runtime_error{"Unable to write block map"};
+
+	const char* data = (const char*) raw.data();
+	size_t remaining = raw.size() * sizeof(long);
+	off_t offset = 0;
+	while(remaining > 0)
+	{
+		ssize_t written = pwrite(fd, data, remaining, offset);
+		if(written <= 0)
+			break;
+		data += written;
+		offset += written;
+		remaining -= written;
+	}
+	fsync(fd);
+	::close(fd);
+}
+
+template <typename T>
+void indexed_vector<T>::rebuildIndex()
+{
+	count_index.assign(block_map.size() + 1, 0);
+	for(size_t i = 1; i <= block_map.size(); i++)
+	{
+		count_index[i] += block_map[i - 1].count;
+		size_t parent = i + (i & -i);
+		if(parent <= block_map.size())
+			count_index[parent] += count_index[i];
+	}
+}
+
+template <typename T>
+void indexed_vector<T>::addCount(long entry, size_type delta)
+{
+	block_map[entry].count += delta;
+	for(size_t i = entry + 1; i < count_index.size(); i += (i & -i))
+		count_index[i] += delta;
+}
+
+template <typename T>
+long indexed_vector<T>::locate(size_type n, size_type& offset) const
+{
+	size_t pos = 0;
+	size_t step = 1;
+	while(step * 2 < count_index.size())
+		step *= 2;
+
+	// descend to the last entry whose elements all come before n
+	for(; step > 0; step /= 2)
+	{
+		if(pos + step < count_index.size() && count_index[pos + step] <= n)
+		{
+			pos += step;
+			n -= count_index[pos];
+		}
+	}
+	offset = n;
+	return pos;
+}
+
+template <typename T>
+BufferFrame* indexed_vector<T>::newBlock(long& physical)
+{
+	if(free_blocks.empty())
+	{
+		BufferFrame* frame = buffered_file->allotFrame();
+		physical = frame->getBlockNumber();
+		return frame;
+	}
+
+	// punched blocks read back as zeros
+	physical = free_blocks.back();
+	free_blocks.pop_back();
+	return buffered_file->readBlock(physical);
+}
+
+template <typename T>
+void indexed_vector<T>::freeBlock(long physical)
+{
+	buffered_file->punchBlocks(physical, 1);
+	free_blocks.push_back(physical);
+}
+
+template <typename T>
+T& indexed_vector<T>::operator[] (indexed_vector<T>::size_type n) {
+	if(n >= sz || n < 0)
+		throw std::out_of_range{"indexed_vector<T>::operator[]"};
+
+	size_type offset;
+	long entry = locate(n, offset);
+
+	BufferFrame* buff = buffered_file->readBlock(block_map[entry].physical);
+	return *(BufferedFrameReader::readPtr<T>(buff, offset * element_size));
+}
+
+template <typename T>
+const T& indexed_vector<T>::operator[] (indexed_vector<T>::size_type n) const {
+	if(n >= sz || n < 0)
+		throw std::out_of_range{"indexed_vector<T>::operator[]"};
+
+	size_type offset;
+	long entry = locate(n, offset);
+
+	BufferFrame* buff = buffered_file->readBlock(block_map[entry].physical);
+	return *((const T*) BufferedFrameReader::readRawData(buff, offset * element_size));
+}
+
+template <typename T>
+void indexed_vector<T>::insert(indexed_vector<T>::size_type pos, const T& elem)
+{
+	if(pos > sz || pos < 0)
+		throw std::out_of_range{"indexed_vector<T>::insert()"};
+
+	long entry;
+	size_type offset;
+	if(block_map.empty() || (pos == sz && block_map.back().count == (size_type) num_elements_per_block))
+	{
+		// a new block at the end
+		block_entry added = { 0, 0 };
+		BufferFrame* frame = newBlock(added.physical);
+		BufferedFrameWriter::write<T>(frame, 0, elem);
+		added.count = 1;
+		block_map.push_back(added);
+		rebuildIndex();
+		sz++;
+		return;
+	}
+
+	if(pos == sz)
+	{
+		entry = block_map.size() - 1;
+		offset = block_map[entry].count;
+	}
+	else
+		entry = locate(pos, offset);
+
+	BufferFrame* frame = buffered_file->readBlock(block_map[entry].physical);
+
+	if(block_map[entry].count == (size_type) num_elements_per_block)
+	{
+		// full, the upper half moves to a new block placed right after this one
+		frame->pin();
+		size_type keep = num_elements_per_block / 2;
+		size_type moved = num_elements_per_block - keep;
+
+		block_entry split = { 0, moved };
+		BufferFrame* split_frame = newBlock(split.physical);
+		BufferedFrameWriter::memcpy(split_frame, BufferedFrameReader::readRawData(frame, keep * element_size), 0, moved * element_size);
+		BufferedFrameWriter::memset(frame, 0, keep * element_size, moved * element_size);
+		frame->unpin();
+
+		block_map[entry].count = keep;
+		block_map.insert(block_map.begin() + entry + 1, split);
+		rebuildIndex();
+
+		if(offset > keep)
+		{
+			entry++;
+			offset -= keep;
+			frame = split_frame;
+		}
+		else
+			frame = buffered_file->readBlock(block_map[entry].physical);
+	}
+
+	size_type count = block_map[entry].count;
+	BufferedFrameWriter::memmove(frame, BufferedFrameReader::readRawData(frame, offset * element_size),
+								 (offset + 1) * element_size, (count - offset) * element_size);
+	BufferedFrameWriter::write<T>(frame, offset * element_size, elem);
+	addCount(entry, 1);
+	sz++;
+}
+
+// the block at pos is cut in two and the new elements go in full blocks between the halves
+template <typename T>
+template <typename InputIterator>
+void indexed_vector<T>::insert(indexed_vector<T>::size_type pos, InputIterator first, InputIterator last)
+{
+	if(pos > sz || pos < 0)
+		throw std::out_of_range{"indexed_vector<T>::insert()"};
+
+	std::vector<T> elems(first, last);
+	size_type n = elems.size();
+	if(n == 0)
+		return;
+
+	long entry;
+	size_type offset;
+	if(block_map.empty())
+	{
+		entry = -1;
+		offset = 0;
+	}
+	else if(pos == sz)
+	{
+		entry = block_map.size() - 1;
+		offset = block_map[entry].count;
+	}
+	else
+		entry = locate(pos, offset);
+
+	size_type done = 0;
+	std::vector<block_entry> added;
+
+	if(entry >= 0)
+	{
+		BufferFrame* frame = buffered_file->readBlock(block_map[entry].physical);
+		size_type count = block_map[entry].count;
+
+		if(count + n <= (size_type) num_elements_per_block)
+		{
+			// fits in the block it lands in
+			BufferedFrameWriter::memmove(frame, BufferedFrameReader::readRawData(frame, offset * element_size),
+										 (offset + n) * element_size, (count - offset) * element_size);
+			BufferedFrameWriter::memcpy(frame, elems.data(), offset * element_size, n * element_size);
+			addCount(entry, n);
+			sz += n;
+			return;
+		}
+
+		frame->pin();
+		block_entry tail = { 0, count - offset };
+		if(tail.count > 0)
+		{
+			BufferFrame* tail_frame = newBlock(tail.physical);
+			BufferedFrameWriter::memcpy(tail_frame, BufferedFrameReader::readRawData(frame, offset * element_size), 0, tail.count * element_size);
+		}
+
+		// top up the front half
+		done = std::min(n, (size_type) num_elements_per_block - offset);
+		BufferedFrameWriter::memcpy(frame, elems.data(), offset * element_size, done * element_size);
+		if(offset + done < (size_type) num_elements_per_block)
+			BufferedFrameWriter::memset(frame, 0, (offset + done) * element_size, (num_elements_per_block - offset - done) * element_size);
+		block_map[entry].count = offset + done;
+		frame->unpin();
+
+		while(done < n)
+		{
+			block_entry full = { 0, std::min(n - done, (size_type) num_elements_per_block) };
+			BufferFrame* new_frame = newBlock(full.physical);
+			BufferedFrameWriter::memcpy(new_frame, elems.data() + done, 0, full.count * element_size);
+			added.push_back(full);
+			done += full.count;
+		}
+		if(tail.count > 0)
+			added.push_back(tail);
+	}
+	else
+	{
+		while(done < n)
+		{
+			block_entry full = { 0, std::min(n - done, (size_type) num_elements_per_block) };
+			BufferFrame* new_frame = newBlock(full.physical);
+			BufferedFrameWriter::memcpy(new_frame, elems.data() + done, 0, full.count * element_size);
+			added.push_back(full);
+			done += full.count;
+		}
+	}
+
+	block_map.insert(block_map.begin() + entry + 1, added.begin(), added.end());
+	rebuildIndex();
+	sz += n;
+}
+
+template <typename T>
+bool indexed_vector<T>::mergeNext(long entry)
+{
+	if(entry < 0 || entry + 1 >= (long) block_map.size())
+		return false;
+
+	size_type count = block_map[entry].count;
+	size_type next_count = block_map[entry + 1].count;
+	if(count + next_count > (size_type) num_elements_per_block)
+		return false;
+
+	BufferFrame* frame = buffered_file->readBlock(block_map[entry].physical);
+	frame->pin();
+	BufferFrame* next = buffered_file->readBlock(block_map[entry + 1].physical);
+	BufferedFrameWriter::memcpy(frame, BufferedFrameReader::readRawData(next, 0), count * element_size, next_count * element_size);
+	frame->unpin();
+
+	freeBlock(block_map[entry + 1].physical);
+	block_map[entry].count += next_count;
+	block_map.erase(block_map.begin() + entry + 1);
+	return true;
+}
+
+template <typename T>
+void indexed_vector<T>::erase(indexed_vector<T>::size_type first, indexed_vector<T>::size_type last)
+{
+	if(first > last)
+		return;
+
+	if(first >= sz || last >= sz || first < 0)
+		throw std::out_of_range{"indexed_vector<T>::erase"};
+
+	size_type offset;
+	long first_entry = locate(first, offset);
+	long entry = first_entry;
+	size_type remaining = last - first + 1;
+
+	// whole blocks in the range are freed, the ones at either end are trimmed
+	while(remaining > 0)
+	{
+		size_type count = block_map[entry].count;
+		size_type take = std::min(remaining, count - offset);
+
+		if(take == count)
+			freeBlock(block_map[entry].physical);
+		else
+		{
+			BufferFrame* frame = buffered_file->readBlock(block_map[entry].physical);
+			BufferedFrameWriter::memmove(frame, BufferedFrameReader::readRawData(frame, (offset + take) * element_size),
+										 offset * element_size, (count - offset - take) * element_size);
+			BufferedFrameWriter::memset(frame, 0, (count - take) * element_size, take * element_size);
+		}
+
+		block_map[entry].count -= take;
+		remaining -= take;
+		offset = 0;
+		entry++;
+	}
+
+	block_map.erase(std::remove_if(block_map.begin() + first_entry, block_map.begin() + entry,
+		[](const block_entry& e) { return e.count == 0; }), block_map.begin() + entry);
+
+	// the blocks either side of the cut may now fit in one
+	long cut = first_entry;
+	if(cut > 0 && mergeNext(cut - 1))
+		cut--;
+	mergeNext(cut);
+
+	sz -= last - first + 1;
+	rebuildIndex();
+
+	if(block_map.size() >= 16 && fill_factor() * 100 < compact_fill_percent)
+		compact();
+}
+
+template <typename T>
+void indexed_vector<T>::pop_back() {
+	if(sz > 0)
+		erase(sz - 1, sz - 1);
+}
+
+template <typename T>
+void indexed_vector<T>::clear() {
+	buffered_file->deleteBlock(1);
+	block_map.clear();
+	free_blocks.clear();
+	rebuildIndex();
+	sz = 0;
+}
+
+// the blocks are packed, in logical order, into new blocks past the end of the
+// file and then copied down to the front, both in large sequential writes
+template <typename T>
+void indexed_vector<T>::compact()
+{
+	long packed_blocks = (sz + num_elements_per_block - 1) / num_elements_per_block;
+	if(packed_blocks == 0)
+	{
+		clear();
+		return;
+	}
+
+	buffered_file->flush();
+
+	std::vector<char> chunk(compact_chunk_blocks * block_size, 0);
+	long chunk_first = -1, chunk_count = 0;
+	size_type slot = 0;
+
+	auto writeChunk = [&]() {
+		long first_block = buffered_file->allotBlock();
+		for(long i = 1; i < chunk_count; i++)
+			buffered_file->allotBlock();
+		if(chunk_first < 0)
+			chunk_first = first_block;
+		buffered_file->writeBlocksDirect(first_block, chunk_count, chunk.data());
+		std::fill(chunk.begin(), chunk.end(), 0);
+		chunk_count = 0;
+	};
+
+	for(size_t e = 0; e < block_map.size(); e++)
+	{
+		BufferFrame* frame = buffered_file->readBlock(block_map[e].physical);
+		const T* data = (const T*) BufferedFrameReader::readRawData(frame, 0);
+		size_type count = block_map[e].count;
+		size_type copied = 0;
+
+		while(copied < count)
+		{
+			size_type room = num_elements_per_block - slot;
+			size_type take = std::min(room, count - copied);
+			std::copy(data + copied, data + copied + take, (T*) (chunk.data() + chunk_count * block_size) + slot);
+			copied += take;
+			slot += take;
+
+			if(slot == (size_type) num_elements_per_block)
+			{
+				slot = 0;
+				if(++chunk_count == compact_chunk_blocks)
+					writeChunk();
+			}
+		}
+	}
+	if(slot > 0)
+		chunk_count++;
+	if(chunk_count > 0)
+		writeChunk();
+
+	// move the packed copy down to blocks 1.., the pool must not hold stale copies of them
+	buffered_file->evictBlocks(1, chunk_first + packed_blocks - 1);
+	for(long b = 0; b < packed_blocks; b += compact_chunk_blocks)
+	{
+		long count = std::min(compact_chunk_blocks, packed_blocks - b);
+		buffered_file->readBlocksDirect(chunk_first + b, count, chunk.data());
+		buffered_file->writeBlocksDirect(1 + b, count, chunk.data());
+	}
+	buffered_file->deleteBlock(packed_blocks + 1);
+
+	block_map.clear();
+	free_blocks.clear();
+	for(long b = 0; b < packed_blocks; b++)
+	{
+		block_entry entry = { b + 1, std::min((size_type) num_elements_per_block, sz - b * (size_type) num_elements_per_block) };
+		block_map.push_back(entry);
+	}
+	rebuildIndex();
+}
+
+#endif
@@ -0,0 +1,267 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstring>
+#include <stddef.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/* block-wise kernels over a contiguous run of elements (one block span)
+ *
+ * for arithmetic 4 and 8 byte types the loops work on 32 byte vectors
+ * (GCC/Clang vector extensions). every kernel is compiled twice, for the
+ * baseline target (two SSE registers per vector on x86-64) and for AVX2,
+ * and the AVX2 one is picked at run time when the CPU has it. any other
+ * type, or another compiler, goes through the plain scalar loops.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_SIMD 1
+#define KERNELS_DISPATCH 1
+#elif defined(__GNUC__)
+#define KERNELS_SIMD 1
+#endif
+
+inline bool cpu_has_avx2()
+{
+#if defined(KERNELS_DISPATCH)
+	static const bool has_avx2 = __builtin_cpu_supports("avx2");
+	return has_avx2;
+#else
+	return false;
+#endif
+}
+
+#if defined(KERNELS_SIMD)
+// the vector loops behind BlockKernels, only instantiated for types they suit
+template <typename T, typename sum_type>
+class SimdKernels
+{
+	static const size_t lanes = 32 / sizeof(T);
+	typedef T vec __attribute__((vector_size(32)));
+	typedef sum_type sum_vec __attribute__((vector_size(lanes * sizeof(sum_type))));
+
+	// vectors only go in and out by reference: a 32 byte vector passed by value
+	// has a different ABI with and without AVX, which GCC warns about
+	__attribute__((always_inline)) static inline void load(vec& v, const T* data) { std::memcpy(&v, data, sizeof(v)); }
+	__attribute__((always_inline)) static inline void splat(vec& v, const T& value) { for(size_t k = 0; k < lanes; k++) v[k] = value; }
+
+public:
+	__attribute__((always_inline)) static inline sum_type sumBody(const T* data, size_t n)
+	{
+		sum_vec acc = {};
+		size_t i = 0;
+		for(; i + lanes <= n; i += lanes)
+		{
+			vec v;
+			load(v, data + i);
+			acc += __builtin_convertvector(v, sum_vec);
+		}
+
+		sum_type total = 0;
+		for(size_t k = 0; k < lanes; k++)
+			total += acc[k];
+		for(; i < n; i++)
+			total += data[i];
+		return total;
+	}
+
+	__attribute__((always_inline)) static inline void minmaxBody(const T* data, size_t n, T& lo, T& hi)
+	{
+		size_t i = 0;
+		if(n >= lanes)
+		{
+			vec vlo, vhi, v;
+			load(vlo, data);
+			vhi = vlo;
+			for(i = lanes; i + lanes <= n; i += lanes)
+			{
+				load(v, data + i);
+				vlo = v < vlo ? v : vlo;
+				vhi = vhi < v ? v : vhi;
+			}
+			for(size_t k = 0; k < lanes; k++)
+			{
+				if(vlo[k] < lo) lo = vlo[k];
+				if(hi < vhi[k]) hi = vhi[k];
+			}
+		}
+		for(; i < n; i++)
+		{
+			if(data[i] < lo) lo = data[i];
+			if(hi < data[i]) hi = data[i];
+		}
+	}
+
+	__attribute__((always_inline)) static inline size_t countBody(const T* data, size_t n, const T& value)
+	{
+		// a true lane compares as -1, a span is far too short for the lane counts to overflow
+		typedef decltype(vec() == vec()) mask;
+		mask acc = {};
+		vec needle, v;
+		splat(needle, value);
+		size_t i = 0;
+		for(; i + lanes <= n; i += lanes)
+		{
+			load(v, data + i);
+			acc -= (v == needle);
+		}
+
+		size_t found = 0;
+		for(size_t k = 0; k < lanes; k++)
+			found += acc[k];
+		for(; i < n; i++)
+			found += (data[i] == value);
+		return found;
+	}
+
+	__attribute__((always_inline)) static inline size_t findBody(const T* data, size_t n, const T& value)
+	{
+		typedef decltype(vec() == vec()) mask;
+		vec needle, v;
+		splat(needle, value);
+		size_t i = 0;
+		for(; i + lanes <= n; i += lanes)
+		{
+			load(v, data + i);
+			mask hit = (v == needle);
+			long long any = 0;
+			for(size_t k = 0; k < lanes; k++)
+				any |= hit[k];
+			if(any)
+				break;
+		}
+		for(; i < n; i++)
+		{
+			if(data[i] == value)
+				break;
+		}
+		return i;
+	}
+
+#if defined(KERNELS_DISPATCH)
+	__attribute__((target("avx2"))) static sum_type sumAvx2(const T* data, size_t n) { return sumBody(data, n); }
+	__attribute__((target("avx2"))) static void minmaxAvx2(const T* data, size_t n, T& lo, T& hi) { minmaxBody(data, n, lo, hi); }
+	__attribute__((target("avx2"))) static size_t countAvx2(const T* data, size_t n, const T& value) { return countBody(data, n, value); }
+	__attribute__((target("avx2"))) static size_t findAvx2(const T* data, size_t n, const T& value) { return findBody(data, n, value); }
+#endif
+};
+#endif
+
+template <typename T>
+class BlockKernels
+{
+public:
+	// wide enough that summing a whole file does not overflow
+	typedef typename std::conditional<std::is_floating_point<T>::value, double,
+		typename std::conditional<std::is_signed<T>::value, long long, unsigned long long>::type>::type sum_type;
+
+private:
+#if defined(KERNELS_SIMD)
+	static const bool use_simd = std::is_arithmetic<T>::value && !std::is_same<T, bool>::value
+		&& (sizeof(T) == 4 || sizeof(T) == 8);
+#else
+	static const bool use_simd = false;
+#endif
+	typedef std::integral_constant<bool, use_simd> simd_tag;
+
+	static sum_type sum(const T* data, size_t n, std::false_type)
+	{
+		sum_type total = 0;
+		for(size_t i = 0; i < n; i++)
+			total += data[i];
+		return total;
+	}
+
+	static void minmax(const T* data, size_t n, T& lo, T& hi, std::false_type)
+	{
+		for(size_t i = 0; i < n; i++)
+		{
+			if(data[i] < lo) lo = data[i];
+			if(hi < data[i]) hi = data[i];
+		}
+	}
+
+	static size_t count(const T* data, size_t n, const T& value, std::false_type)
+	{
+		size_t found = 0;
+		for(size_t i = 0; i < n; i++)
+			found += (data[i] == value);
+		return found;
+	}
+
+	static size_t find(const T* data, size_t n, const T& value, std::false_type)
+	{
+		for(size_t i = 0; i < n; i++)
+		{
+			if(data[i] == value)
+				return i;
+		}
+		return n;
+	}
+
+#if defined(KERNELS_SIMD)
+	static sum_type sum(const T* data, size_t n, std::true_type)
+	{
+#if defined(KERNELS_DISPATCH)
+		if(cpu_has_avx2())
+			return SimdKernels<T, sum_type>::sumAvx2(data, n);
+#endif
+		return SimdKernels<T, sum_type>::sumBody(data, n);
+	}
+
+	static void minmax(const T* data, size_t n, T& lo, T& hi, std::true_type)
+	{
+#if defined(KERNELS_DISPATCH)
+		if(cpu_has_avx2())
+			return SimdKernels<T, sum_type>::minmaxAvx2(data, n, lo, hi);
+#endif
+		SimdKernels<T, sum_type>::minmaxBody(data, n, lo, hi);
+	}
+
+	static size_t count(const T* data, size_t n, const T& value, std::true_type)
+	{
+#if defined(KERNELS_DISPATCH)
+		if(cpu_has_avx2())
+			return SimdKernels<T, sum_type>::countAvx2(data, n, value);
+#endif
+		return SimdKernels<T, sum_type>::countBody(data, n, value);
+	}
+
+	static size_t find(const T* data, size_t n, const T& value, std::true_type)
+	{
+#if defined(KERNELS_DISPATCH)
+		if(cpu_has_avx2())
+			return SimdKernels<T, sum_type>::findAvx2(data, n, value);
+#endif
+		return SimdKernels<T, sum_type>::findBody(data, n, value);
+	}
+#endif
+
+public:
+	static sum_type sum(const T* data, size_t n) { return sum(data, n, simd_tag()); }
+
+	// folds the span into lo and hi, which the caller seeds
+	static void minmax(const T* data, size_t n, T& lo, T& hi) { minmax(data, n, lo, hi, simd_tag()); }
+
+	static size_t count(const T* data, size_t n, const T& value) { return count(data, n, value, simd_tag()); }
+
+	// position of the first element equal to value, n when there is none
+	static size_t find(const T* data, size_t n, const T& value) { return find(data, n, value, simd_tag()); }
+
+	// adds the span to bins equal-width bins over [lo, hi), values outside are not counted
+	static void histogram(const T* data, size_t n, const T& lo, const T& hi, std::vector<long long>& bins)
+	{
+		double scale = bins.size() / ((double) hi - (double) lo);
+		for(size_t i = 0; i < n; i++)
+		{
+			if(data[i] < lo || !(data[i] < hi))
+				continue;
+			size_t bin = (size_t) (((double) data[i] - (double) lo) * scale);
+			bins[bin < bins.size() ? bin : bins.size() - 1]++;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef LEARNED_INDEX_H
+#define LEARNED_INDEX_H
+
+#include "vector.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+/* learned index over a sorted vector of integer keys
+ *
+ * the position of a key in a sorted vector is a monotone function of the
+ * key, which a few straight line segments approximate well for keys such
+ * as timestamps or ids. the segments are fitted in one pass with a
+ * shrinking cone: a segment starts at a point and keeps the range of
+ * slopes that pass within epsilon positions of every point after it, it
+ * ends at the first point that empties that range. a lookup binary
+ * searches the segments in memory, predicts the position and searches
+ * only the 2 * epsilon + 3 elements around it, one or two blocks as long
+ * as that window fits in a block.
+ *
+ * a key repeated d > 1 times contributes the point of its first position
+ * and, just after the key, the point of the position past its last, so
+ * the prediction brackets the answer for any key. the model works in
+ * doubles, so it is exact for keys up to 2^53 in magnitude. the vector
+ * must not change while the index is in use.
+ */
+
+template <typename T, size_t BlockSize = 0>
+class learned_index
+{
+	static_assert(std::is_integral<T>::value, "learned_index<T> models integer keys");
+
+public:
+	typedef typename vector<T, BlockSize>::size_type size_type;
+
+private:
+	struct segment {
+		// the smallest key the segment answers for
+		T first_key;
+		// the segment's line runs through (first_x, first_pos)
+		double first_x;
+		// the last point the segment was fitted to, keys past it are in no segment
+		double last_x;
+		size_type first_pos;
+		double slope;
+	};
+
+	vector<T, BlockSize>* vec;
+	const size_type epsilon;
+	size_type sz;
+	std::vector<segment> segments;
+
+	// the segment being fitted and its cone of slopes
+	double origin_x, origin_y, slope_lo, slope_hi, fitted_x;
+	bool fitting;
+
+	void addPoint(double x, double y);
+	void closeSegment();
+	// the first index in [first, last) whose key is not below key, last when there is none
+	size_type searchRange(size_type first, size_type last, const T& key);
+
+public:
+	// fits the model with one sequential pass over v, which must be sorted ascending
+	learned_index(vector<T, BlockSize>& v, size_type eps = 64);
+
+	size_type size() const { return sz; }
+	size_t num_segments() const { return segments.size(); }
+	// bytes the model takes in memory
+	size_t index_bytes() const { return segments.size() * sizeof(segment); }
+
+	// the index std::lower_bound/upper_bound would give
+	size_type lower_bound(const T& key);
+	size_type upper_bound(const T& key) { return key == std::numeric_limits<T>::max() ? sz : lower_bound(key + 1); }
+	bool contains(const T& key)
+	{
+		size_type n = lower_bound(key);
+		return n < sz && ((const vector<T, BlockSize>&) *vec)[n] == key;
+	}
+};
+
+template <typename T, size_t BlockSize>
+learned_index<T, BlockSize>::learned_index(vector<T, BlockSize>& v, size_type eps) : vec(&v), epsilon(std::max(eps, (size_type) 1)),
+	sz(v.size()), fitting(false) {
+	size_type n = 0;
+	size_type run_start = 0;
+	T run_key = T();
+
+	for(auto span : vec->cblocks())
+	{
+		for(size_type i = 0; i < span.size(); i++, n++)
+		{
+			if(n > 0 && span[i] == run_key)
+				continue;
+			if(n > 0 && span[i] < run_key)
+				throw std::invalid_argument{"learned_index<T>: vector is not sorted"};
+
+			// the run of the previous key ended here
+			if(n - run_start > 1)
+				addPoint((double) run_key + 0.5, (double) n);
+			run_key = span[i];
+			run_start = n;
+			addPoint((double) run_key, (double) n);
+		}
+	}
+	if(n - run_start > 1)
+		addPoint((double) run_key + 0.5, (double) n);
+	if(fitting)
+		closeSegment();
+}
+
+template <typename T, size_t BlockSize>
+void learned_index<T, BlockSize>::addPoint(double x, double y) {
+	if(fitting)
+	{
+		double dx = x - origin_x;
+		double lo = (y - epsilon - origin_y) / dx;
+		double hi = (y + epsilon - origin_y) / dx;
+		if(lo <= slope_hi && hi >= slope_lo)
+		{
+			slope_lo = std::max(slope_lo, lo);
+			slope_hi = std::min(slope_hi, hi);
+			fitted_x = x;
+			return;
+		}
+		closeSegment();
+	}
+
+	// a segment starting past the end of a run answers for the keys above that run
+	segment next = { (T) std::ceil(x), x, x, (size_type) y, 0.0 };
+	segments.push_back(next);
+	origin_x = x;
+	origin_y = y;
+	fitted_x = x;
+	slope_lo = 0;
+	slope_hi = std::numeric_limits<double>::infinity();
+	fitting = true;
+}
+
+template <typename T, size_t BlockSize>
+void learned_index<T, BlockSize>::closeSegment() {
+	segment& last = segments.back();
+	last.last_x = fitted_x;
+	last.slope = std::isinf(slope_hi) ? 0.0 : (slope_lo + slope_hi) / 2;
+	fitting = false;
+}
+
+template <typename T, size_t BlockSize>
+typename learned_index<T, BlockSize>::size_type learned_index<T, BlockSize>::searchRange(size_type first, size_type last, const T& key) {
+	size_type per_block = vec->elements_per_block();
+
+	// the window spans one block, or two when it crosses a boundary. each is read on
+	// its own, a block iterator would read ahead past the window.
+	while(first < last)
+	{
+		long b = (long) (first / per_block);
+		auto span = vec->cblock(b);
+		size_type block_first = b * per_block;
+		const T* from = span.begin() + (first - block_first);
+		const T* to = span.begin() + std::min(last - block_first, span.size());
+		const T* found = std::lower_bound(from, to, key);
+		if(found != to)
+			return block_first + (found - span.begin());
+
+		first = block_first + (to - span.begin());
+	}
+	return last;
+}
+
+template <typename T, size_t BlockSize>
+typename learned_index<T, BlockSize>::size_type learned_index<T, BlockSize>::lower_bound(const T& key) {
+	if(segments.empty() || key <= segments[0].first_key)
+		return 0;
+
+	auto next = std::upper_bound(segments.begin(), segments.end(), key, [](const T& k, const segment& s) { return k < s.first_key; });
+	const segment& s = *(next - 1);
+
+	// past the keys of this segment, the answer is where the next one starts
+	if((double) key > s.last_x)
+		return next == segments.end() ? sz : next->first_pos;
+
+	double predicted = s.first_pos + s.slope * ((double) key - s.first_x);
+	size_type first = std::max((size_type) std::floor(predicted) - epsilon - 1, (size_type) 0);
+	size_type last = std::min((size_type) std::ceil(predicted) + epsilon + 2, sz);
+	return searchRange(first, last, key);
+}
+
+#endif
@@ -0,0 +1,620 @@
+#ifndef PACKED_VECTOR_H
+#define PACKED_VECTOR_H
+
+#include "buffer.h"
+#include "kernels.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/* compressed vector of 4 or 8 byte integers
+ *
+ * elements are taken a block's worth (block_size / sizeof(T)) at a time
+ * and every such block is stored bit-packed, either as its offsets from
+ * the block minimum (frame of reference) or, when it is sorted and that
+ * comes out smaller, as the differences between neighbours (delta). a
+ * block of sorted ids or timestamps usually needs a few bits per element
+ * instead of 32 or 64, and a block of one repeated value needs none.
+ *
+ * the encoded blocks follow each other as one byte stream over the data
+ * blocks of the file. the block index (min, max, byte offset, count and
+ * bit width of every block) lives in memory and is written to
+ * <path>.idx on close, so element n is found without reading anything
+ * but its own block. elements past the last full block are kept in
+ * memory until close, when they are written as a final short block.
+ *
+ * values are packed across lanes: value i goes to lane i % lanes, so a
+ * block unpacks one 32 byte vector of values per step.
+ */
+
+#if defined(KERNELS_SIMD)
+template <typename word>
+class SimdUnpack
+{
+	static const size_t lanes = 32 / sizeof(word);
+	static const int word_bits = 8 * sizeof(word);
+	typedef word vec __attribute__((vector_size(32)));
+
+	// by reference, a 32 byte vector passed by value changes the ABI without AVX
+	__attribute__((always_inline)) static inline void load(vec& v, const word* data) { std::memcpy(&v, data, sizeof(v)); }
+
+public:
+	__attribute__((always_inline)) static inline void unpackBody(const word* in, size_t lane_values, int bits, word* out)
+	{
+		word low_bits = bits == word_bits ? ~(word) 0 : (((word) 1 << bits) - 1);
+		vec mask;
+		for(size_t k = 0; k < lanes; k++)
+			mask[k] = low_bits;
+
+		size_t bit = 0;
+		for(size_t j = 0; j < lane_values; j++, bit += bits)
+		{
+			size_t w = bit / word_bits;
+			int shift = bit % word_bits;
+			vec v, next;
+			load(v, in + w * lanes);
+			v >>= shift;
+			if(shift + bits > word_bits)
+			{
+				load(next, in + (w + 1) * lanes);
+				v |= next << (word_bits - shift);
+			}
+			v &= mask;
+			std::memcpy(out + j * lanes, &v, sizeof(v));
+		}
+	}
+
+#if defined(KERNELS_DISPATCH)
+	__attribute__((target("avx2"))) static void unpackAvx2(const word* in, size_t lane_values, int bits, word* out) { unpackBody(in, lane_values, bits, out); }
+#endif
+};
+#endif
+
+// lane-interleaved bit-packing of unsigned words
+template <typename word>
+class BitPacker
+{
+public:
+	static const size_t lanes = 32 / sizeof(word);
+	static const int word_bits = 8 * sizeof(word);
+
+	static int bitWidth(word value)
+	{
+		int bits = 0;
+		for(; value != 0; value >>= 1)
+			bits++;
+		return bits;
+	}
+
+	// values of one lane, rounded up, and the words n values take at this width
+	static size_t laneValues(size_t n) { return (n + lanes - 1) / lanes; }
+	static size_t packedWords(size_t n, int bits) { return (laneValues(n) * bits + word_bits - 1) / word_bits * lanes; }
+
+	// out must hold packedWords(n, bits) words
+	static void pack(const word* values, size_t n, int bits, word* out)
+	{
+		std::fill(out, out + packedWords(n, bits), (word) 0);
+		for(size_t i = 0; i < n; i++)
+		{
+			size_t bit = (i / lanes) * bits;
+			size_t w = bit / word_bits;
+			int shift = bit % word_bits;
+			out[w * lanes + i % lanes] |= values[i] << shift;
+			if(shift + bits > word_bits)
+				out[(w + 1) * lanes + i % lanes] |= values[i] >> (word_bits - shift);
+		}
+	}
+
+	// out must hold laneValues(n) * lanes words
+	static void unpack(const word* in, size_t n, int bits, word* out)
+	{
+		if(bits == 0)
+		{
+			std::fill(out, out + laneValues(n) * lanes, (word) 0);
+			return;
+		}
+#if defined(KERNELS_SIMD)
+#if defined(KERNELS_DISPATCH)
+		if(cpu_has_avx2())
+			return SimdUnpack<word>::unpackAvx2(in, laneValues(n), bits, out);
+#endif
+		SimdUnpack<word>::unpackBody(in, laneValues(n), bits, out);
+#else
+		word mask = bits == word_bits ? ~(word) 0 : (((word) 1 << bits) - 1);
+		for(size_t i = 0; i < laneValues(n) * lanes; i++)
+			out[i] = extract(in, i, bits) & mask;
+#endif
+	}
+
+	// value i alone, without unpacking the rest
+	static word extract(const word* in, size_t i, int bits)
+	{
+		if(bits == 0)
+			return 0;
+		size_t bit = (i / lanes) * bits;
+		size_t w = bit / word_bits;
+		int shift = bit % word_bits;
+		word value = in[w * lanes + i % lanes] >> shift;
+		if(shift + bits > word_bits)
+			value |= in[(w + 1) * lanes + i % lanes] << (word_bits - shift);
+		return bits == word_bits ? value : value & (((word) 1 << bits) - 1);
+	}
+};
+
+template <typename T>
+class packed_vector
+{
+	static_assert(std::is_integral<T>::value && (sizeof(T) == 4 || sizeof(T) == 8), "packed_vector<T> packs 4 and 8 byte integers");
+
+public:
+	typedef long long int size_type;
+private:
+	typedef typename std::make_unsigned<T>::type word;
+	typedef BitPacker<word> packer;
+
+	enum { FRAME_OF_REFERENCE = 0, DELTA = 1 };
+
+	struct block_entry {
+		T min, max;
+		uint64_t offset;    // bytes into the stream of encoded blocks
+		uint32_t count;
+		uint8_t bits;
+		uint8_t encoding;
+	};
+
+	const size_t block_size;
+	const size_t num_elements_per_block;
+	BufferedFile* buffered_file;
+	std::string index_path;
+	size_type sz;
+	bool closed;
+
+	std::vector<block_entry> index;
+	// end of the encoded stream
+	uint64_t stream_bytes;
+	// the elements after the last encoded block
+	std::vector<T> tail;
+
+	// scratch for one block: packed words, unpacked words
+	std::vector<word> packed, unpacked;
+	// the last block decoded, for operator[] on delta blocks
+	std::vector<T> decoded;
+	long decoded_block;
+
+	void encodeBlock(const T* data, size_t n);
+	// the packed words of block b, read into packed when they cross a block boundary
+	const word* blockWords(long b);
+	void decodeBlock(long b, T* out);
+	void writeStream(uint64_t offset, const void* src, size_t size);
+	void readStream(uint64_t offset, void* dst, size_t size);
+	void loadIndex();
+	void saveIndex();
+
+public:
+	packed_vector(const char* pathname, size_type blocksize, BufferedFile::OpenMode mode = BufferedFile::READ_WRITE);
+	// closes the vector if close() was not called, any error is swallowed
+	~packed_vector();
+	// writes the tail, the block index and the header, and throws if they cannot be
+	// written. the vector is not used after it.
+	void close();
+
+	size_type size() { return sz; }
+	size_type elements_per_block() const { return num_elements_per_block; }
+	// encoded blocks, the in-memory tail not included
+	long num_blocks() const { return index.size(); }
+	// bytes the encoded blocks take on disk, against sizeof(T) per element unpacked
+	uint64_t compressed_bytes() const { return stream_bytes; }
+
+	void push_back(const T& elem);
+	void append(const T* elems, size_type n);
+	void clear();
+
+	// decodes only element n of a frame of reference block, the whole block for delta
+	T operator[] (size_type n);
+
+	// calls fn(first, data, count) for every block in turn with the decoded elements
+	// first to first + count - 1
+	template <typename Function>
+	void scan(Function fn);
+	// the same, only for blocks whose [min, max] meets [lo, hi]. the others are not read.
+	template <typename Function>
+	void scan(const T& lo, const T& hi, Function fn);
+
+	// range of every element, from the block index and the tail, nothing is decoded
+	std::pair<T, T> minmax();
+};
+
+template <typename T>
+packed_vector<T>::packed_vector(const char* pathname, size_type blocksize, BufferedFile::OpenMode mode) : block_size(blocksize),
+	num_elements_per_block(blocksize/(sizeof(T))), index_path(std::string(pathname) + ".idx"), sz(0), closed(false), stream_bytes(0), decoded_block(-1) {
+	if(num_elements_per_block == 0 || block_size < sizeof(long) + sizeof(size_type))
+		throw std::invalid_argument{"packed_vector<T>: block size does not fit"};
+
+	buffered_file = new BufferedFile(pathname, block_size, block_size*10, mode);
+
+	BufferFrame* header = buffered_file->readHeader();
+	sz = BufferedFrameReader::read<size_type>(header, sizeof(long));
+
+	size_t lane_words = packer::laneValues(num_elements_per_block) * packer::lanes;
+	packed.resize(lane_words);
+	unpacked.resize(lane_words);
+	decoded.resize(lane_words);
+	tail.reserve(num_elements_per_block);
+
+	loadIndex();
+}
+
+template <typename T>
+packed_vector<T>::~packed_vector()
+{
+	try
+	{
+		close();
+	}
+	catch(...)
+	{
+	}
+
+	delete buffered_file;
+}
+
+template <typename T>
+void packed_vector<T>::close()
+{
+	if(closed)
+		return;
+
+	if(!buffered_file->isReadOnly())
+	{
+		// the tail goes out as a short block and is read back into memory on open.
+		// it is encoded once, a close() that failed after it only retries the rest.
+		if(!tail.empty())
+		{
+			encodeBlock(tail.data(), tail.size());
+			tail.clear();
+		}
+		saveIndex();
+		BufferedFrameWriter::write<size_type>(buffered_file->readHeader(), sizeof(long), sz);
+		buffered_file->writeHeader();
+	}
+	closed = true;
+}
+
+template <typename T>
+void packed_vector<T>::loadIndex()
+{
+	index.clear();
+	tail.clear();
+	stream_bytes = 0;
+
+	int fd = open(index_path.c_str(), O_RDONLY);
+	if(fd == -1)
+	{
+		if(sz != 0)
+			throw std::runtime_error{"Block index missing"};
+		return;
+	}
+
+	uint64_t count = 0;
+	bool valid = pread(fd, &count, sizeof(count), 0) == sizeof(count);
+	if(valid)
+	{
+		index.resize(count);
+		valid = count == 0 || pread(fd, index.data(), count * sizeof(block_entry), sizeof(count)) == (ssize_t) (count * sizeof(block_entry));
+	}
+	::close(fd);
+
+	size_type total = 0;
+	for(size_t b = 0; valid && b < index.size(); b++)
+	{
+		valid = index[b].offset == stream_bytes && index[b].count <= num_elements_per_block;
+		stream_bytes += packer::packedWords(index[b].count, index[b].bits) * sizeof(word);
+		total += index[b].count;
+	}
+
+	if(!valid || total != sz)
+		throw std::runtime_error{"Block index does not match the file"};
+
+	// a short last block is the tail written on close
+	if(!index.empty() && index.back().count < num_elements_per_block)
+	{
+		decodeBlock(index.size() - 1, decoded.data());
+		tail.assign(decoded.begin(), decoded.begin() + index.back().count);
+		stream_bytes = index.back().offset;
+		index.pop_back();
+		decoded_block = -1;
+	}
+}
+
+template <typename T>
+void packed_vector<T>::saveIndex()
+{
+	std::vector<char> raw(sizeof(uint64_t) + index.size() * sizeof(block_entry));
+	uint64_t count = index.size();
+	std::memcpy(raw.data(), &count, sizeof(count));
+	if(count > 0)
+		std::memcpy(raw.data() + sizeof(count), index.data(), count * sizeof(block_entry));
+
+	int fd = open(index_path.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0755);
+	if(fd == -1)
+		throw std::runtime_error{"Unable to write block index"};
+
+	const char* data = raw.data();
+	size_t remaining = raw.size();
+	off_t offset = 0;
+	while(remaining > 0)
+	{
+		ssize_t written = pwrite(fd, data, remaining, offset);
+		if(written <= 0)
+			break;
+		data += written;
+		offset += written;
+		remaining -= written;
+	}
+	fsync(fd);
+	::close(fd);
+}
+
+template <typename T>
+void packed_vector<T>::writeStream(uint64_t offset, const void* src, size_t size)
+{
+	const char* data = (const char*) src;
+	while(size > 0)
+	{
+		long block_number = 1 + offset / block_size;
+		size_t within = offset % block_size;
+		size_t chunk = std::min(size, block_size - within);
+
+		// the stream only ever grows at its end, so a new block is always the next one
+		BufferFrame* frame = block_number > buffered_file->getLastBlock() ? buffered_file->allotFrame() : buffered_file->readBlock(block_number);
+		BufferedFrameWriter::memcpy(frame, data, within, chunk);
+
+		data += chunk;
+		offset += chunk;
+		size -= chunk;
+	}
+}
+
+template <typename T>
+void packed_vector<T>::readStream(uint64_t offset, void* dst, size_t size)
+{
+	char* data = (char*) dst;
+	while(size > 0)
+	{
+		long block_number = 1 + offset / block_size;
+		size_t within = offset % block_size;
+		size_t chunk = std::min(size, block_size - within);
+
+		BufferFrame* frame = buffered_file->readBlock(block_number);
+		std::memcpy(data, BufferedFrameReader::readRawData(frame, within), chunk);
+
+		data += chunk;
+		offset += chunk;
+		size -= chunk;
+	}
+}
+
+template <typename T>
+void packed_vector<T>::encodeBlock(const T* data, size_t n)
+{
+	T lo = data[0], hi = data[0];
+	BlockKernels<T>::minmax(data, n, lo, hi);
+
+	bool sorted = true;
+	word max_delta = 0;
+	for(size_t i = 1; i < n && sorted; i++)
+	{
+		sorted = !(data[i] < data[i - 1]);
+		max_delta = std::max(max_delta, (word) ((word) data[i] - (word) data[i - 1]));
+	}
+
+	int for_bits = packer::bitWidth((word) hi - (word) lo);
+	int delta_bits = sorted ? packer::bitWidth(max_delta) : packer::word_bits;
+
+	block_entry entry;
+	entry.min = lo;
+	entry.max = hi;
+	entry.offset = stream_bytes;
+	entry.count = n;
+	if(sorted && delta_bits < for_bits)
+	{
+		entry.bits = delta_bits;
+		entry.encoding = DELTA;
+		unpacked[0] = 0;
+		for(size_t i = 1; i < n; i++)
+			unpacked[i] = (word) data[i] - (word) data[i - 1];
+	}
+	else
+	{
+		entry.bits = for_bits;
+		entry.encoding = FRAME_OF_REFERENCE;
+		for(size_t i = 0; i < n; i++)
+			unpacked[i] = (word) data[i] - (word) lo;
+	}
+
+	packer::pack(unpacked.data(), n, entry.bits, packed.data());
+	size_t bytes = packer::packedWords(n, entry.bits) * sizeof(word);
+	writeStream(stream_bytes, packed.data(), bytes);
+
+	stream_bytes += bytes;
+	index.push_back(entry);
+}
+
+template <typename T>
+const typename packed_vector<T>::word* packed_vector<T>::blockWords(long b)
+{
+	const block_entry& entry = index[b];
+	size_t bytes = packer::packedWords(entry.count, entry.bits) * sizeof(word);
+	if(bytes == 0)
+		return packed.data();
+
+	// most blocks sit inside one data block and are decoded straight from its frame
+	size_t within = entry.offset % block_size;
+	if(within + bytes <= block_size)
+		return (const word*) BufferedFrameReader::readRawData(buffered_file->readBlock(1 + entry.offset / block_size), within);
+
+	readStream(entry.offset, packed.data(), bytes);
+	return packed.data();
+}
+
+template <typename T>
+void packed_vector<T>::decodeBlock(long b, T* out)
+{
+	const block_entry& entry = index[b];
+	packer::unpack(blockWords(b), entry.count, entry.bits, unpacked.data());
+
+	if(entry.encoding == FRAME_OF_REFERENCE)
+	{
+		word base = entry.min;
+		for(size_t i = 0; i < entry.count; i++)
+			out[i] = (T) (base + unpacked[i]);
+	}
+	else
+	{
+		word value = entry.min;
+		for(size_t i = 0; i < entry.count; i++)
+		{
+			value += unpacked[i];
+			out[i] = (T) value;
+		}
+	}
+}
+
+template <typename T>
+void packed_vector<T>::push_back(const T& elem)
+{
+	tail.push_back(elem);
+	sz++;
+	if(tail.size() == num_elements_per_block)
+	{
+		encodeBlock(tail.data(), tail.size());
+		tail.clear();
+	}
+}
+
+template <typename T>
+void packed_vector<T>::append(const T* elems, size_type n)
+{
+	sz += n;
+	while(n > 0)
+	{
+		// whole blocks are encoded from the caller's array, only the rest is copied
+		if(tail.empty() && n >= (size_type) num_elements_per_block)
+		{
+			encodeBlock(elems, num_elements_per_block);
+			elems += num_elements_per_block;
+			n -= num_elements_per_block;
+			continue;
+		}
+
+		size_type take = std::min(n, (size_type) (num_elements_per_block - tail.size()));
+		tail.insert(tail.end(), elems, elems + take);
+		elems += take;
+		n -= take;
+		if(tail.size() == num_elements_per_block)
+		{
+			encodeBlock(tail.data(), tail.size());
+			tail.clear();
+		}
+	}
+}
+
+template <typename T>
+void packed_vector<T>::clear()
+{
+	buffered_file->deleteBlock(1);
+	index.clear();
+	tail.clear();
+	stream_bytes = 0;
+	decoded_block = -1;
+	sz = 0;
+}
+
+template <typename T>
+T packed_vector<T>::operator[] (size_type n)
+{
+	if(n >= sz || n < 0)
+		throw std::out_of_range{"packed_vector<T>::operator[]"};
+
+	long b = n / num_elements_per_block;
+	size_t i = n % num_elements_per_block;
+	if(b == (long) index.size())
+		return tail[i];
+
+	const block_entry& entry = index[b];
+	if(entry.encoding == FRAME_OF_REFERENCE)
+		return (T) ((word) entry.min + packer::extract(blockWords(b), i, entry.bits));
+
+	if(decoded_block != b)
+	{
+		decodeBlock(b, decoded.data());
+		decoded_block = b;
+	}
+	return decoded[i];
+}
+
+template <typename T>
+template <typename Function>
+void packed_vector<T>::scan(Function fn)
+{
+	scan(std::numeric_limits<T>::min(), std::numeric_limits<T>::max(), fn);
+}
+
+template <typename T>
+template <typename Function>
+void packed_vector<T>::scan(const T& lo, const T& hi, Function fn)
+{
+	// the encoded stream is read ahead in runs of this many blocks
+	const long prefetch_blocks = 64;
+	long prefetched = 0;
+
+	std::vector<T> out(decoded.size());
+	for(size_t b = 0; b < index.size(); b++)
+	{
+		if(index[b].max < lo || hi < index[b].min)
+			continue;
+
+		long block_number = 1 + index[b].offset / block_size;
+		if(block_number + prefetch_blocks / 2 > prefetched)
+		{
+			long first = std::max(prefetched + 1, block_number);
+			buffered_file->prefetchBlocks(first, block_number + prefetch_blocks - first);
+			prefetched = block_number + prefetch_blocks - 1;
+		}
+
+		decodeBlock(b, out.data());
+		fn((size_type) b * num_elements_per_block, (const T*) out.data(), (size_t) index[b].count);
+	}
+
+	if(!tail.empty())
+	{
+		T tail_lo = tail[0], tail_hi = tail[0];
+		BlockKernels<T>::minmax(tail.data(), tail.size(), tail_lo, tail_hi);
+		if(!(tail_hi < lo || hi < tail_lo))
+			fn((size_type) index.size() * num_elements_per_block, (const T*) tail.data(), tail.size());
+	}
+}
+
+template <typename T>
+std::pair<T, T> packed_vector<T>::minmax()
+{
+	if(sz == 0)
+		throw std::out_of_range{"packed_vector<T>::minmax()"};
+
+	T lo = tail.empty() ? index[0].min : tail[0], hi = lo;
+	for(size_t b = 0; b < index.size(); b++)
+	{
+		lo = std::min(lo, index[b].min);
+		hi = std::max(hi, index[b].max);
+	}
+	BlockKernels<T>::minmax(tail.data(), tail.size(), lo, hi);
+	return std::make_pair(lo, hi);
+}
+
+#endif
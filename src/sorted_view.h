@@ -0,0 +1,149 @@
+#ifndef SORTED_VIEW_H
+#define SORTED_VIEW_H
+
+#include "vector.h"
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/* binary search over a sorted vector<T>, one block read per lookup
+ *
+ * std::lower_bound through operator[] reads a block for nearly every one
+ * of its log2(n) probes. here the first key of every block is kept in
+ * memory, built with one sequential pass over the vector, so a search
+ * picks the block the key falls in without any I/O and then only
+ * searches inside that block. the index is rebuilt when the vector's size
+ * has changed, call rebuild() after changing elements in place.
+ *
+ * with EYTZINGER the first keys are stored in breadth-first order of an
+ * implicit search tree, which keeps the top levels of every search in the
+ * same cache lines and lets the next levels be prefetched.
+ */
+
+template <typename T, typename Compare = std::less<T>, size_t BlockSize = 0>
+class sorted_view
+{
+public:
+	typedef typename vector<T, BlockSize>::size_type size_type;
+
+	enum Layout {
+		SORTED,         // first keys in order, searched with std::partition_point
+		EYTZINGER       // first keys in breadth-first tree order
+	};
+
+private:
+	vector<T, BlockSize>* vec;
+	Compare comp;
+	Layout layout;
+	size_type indexed_size;
+
+	// SORTED: first key of block b at b. EYTZINGER: the tree from 1, node k's children at 2k and 2k + 1
+	std::vector<T> first_keys;
+	// EYTZINGER only, the block of every tree node
+	std::vector<long> node_blocks;
+
+	void buildTree(const std::vector<T>& keys, size_t& next, size_t node);
+	// number of blocks whose first key satisfies pred, which holds for a prefix of them
+	template <typename Predicate>
+	long blocksBefore(Predicate pred);
+	// searches block b only, the answer may be the first index past it
+	template <typename BlockSearch>
+	size_type searchBlock(long b, BlockSearch search);
+	void refresh() { if(indexed_size != vec->size()) rebuild(); }
+
+public:
+	sorted_view(vector<T, BlockSize>& v, Compare c = Compare(), Layout l = SORTED) : vec(&v), comp(c), layout(l), indexed_size(-1) {}
+
+	// reads every block once to collect its first key
+	void rebuild();
+	// bytes the in-memory index takes
+	size_t index_bytes() const { return first_keys.size() * sizeof(T) + node_blocks.size() * sizeof(long); }
+	// blocks the vector has read from the file so far, a lookup adds at most one
+	long blocks_read() const { return vec->blocks_read(); }
+
+	// indices as std::lower_bound/upper_bound/equal_range would give them
+	size_type lower_bound(const T& key);
+	size_type upper_bound(const T& key);
+	std::pair<size_type, size_type> equal_range(const T& key) { return std::make_pair(lower_bound(key), upper_bound(key)); }
+};
+
+template <typename T, typename Compare, size_t BlockSize>
+void sorted_view<T, Compare, BlockSize>::rebuild() {
+	std::vector<T> keys;
+	keys.reserve(vec->num_blocks());
+	for(auto span : vec->cblocks())
+		keys.push_back(span[0]);
+
+	node_blocks.clear();
+	if(layout == EYTZINGER)
+	{
+		first_keys.assign(keys.size() + 1, T());
+		node_blocks.assign(keys.size() + 1, 0);
+		size_t next = 0;
+		buildTree(keys, next, 1);
+	}
+	else
+		first_keys.swap(keys);
+
+	indexed_size = vec->size();
+}
+
+template <typename T, typename Compare, size_t BlockSize>
+void sorted_view<T, Compare, BlockSize>::buildTree(const std::vector<T>& keys, size_t& next, size_t node) {
+	// an in-order walk of the tree hands out the keys in sorted order
+	if(node >= first_keys.size())
+		return;
+	buildTree(keys, next, 2 * node);
+	first_keys[node] = keys[next];
+	node_blocks[node] = next++;
+	buildTree(keys, next, 2 * node + 1);
+}
+
+template <typename T, typename Compare, size_t BlockSize>
+template <typename Predicate>
+long sorted_view<T, Compare, BlockSize>::blocksBefore(Predicate pred) {
+	if(layout == SORTED)
+		return std::partition_point(first_keys.begin(), first_keys.end(), pred) - first_keys.begin();
+
+	size_t n = first_keys.size() - 1;
+	size_t k = 1;
+	while(k <= n)
+	{
+		__builtin_prefetch(first_keys.data() + std::min(16 * k, n));
+		k = 2 * k + (pred(first_keys[k]) ? 1 : 0);
+	}
+	// the last node where the search went left is the first key pred fails on
+	k >>= __builtin_ffsll(~(unsigned long long) k);
+	return k == 0 ? (long) n : node_blocks[k];
+}
+
+template <typename T, typename Compare, size_t BlockSize>
+template <typename BlockSearch>
+typename sorted_view<T, Compare, BlockSize>::size_type sorted_view<T, Compare, BlockSize>::searchBlock(long b, BlockSearch search) {
+	if(b < 0)
+		return 0;
+
+	// only the one block, a point lookup has no use for read-ahead
+	auto span = vec->cblock(b);
+	return b * (size_type) vec->elements_per_block() + (search(span.begin(), span.end()) - span.begin());
+}
+
+template <typename T, typename Compare, size_t BlockSize>
+typename sorted_view<T, Compare, BlockSize>::size_type sorted_view<T, Compare, BlockSize>::lower_bound(const T& key) {
+	refresh();
+	Compare& c = comp;
+	// the last block starting below key holds the answer, or it is the start of the next block
+	long b = blocksBefore([&c, &key](const T& first) { return c(first, key); }) - 1;
+	return searchBlock(b, [&c, &key](const T* first, const T* last) { return std::lower_bound(first, last, key, c); });
+}
+
+template <typename T, typename Compare, size_t BlockSize>
+typename sorted_view<T, Compare, BlockSize>::size_type sorted_view<T, Compare, BlockSize>::upper_bound(const T& key) {
+	refresh();
+	Compare& c = comp;
+	long b = blocksBefore([&c, &key](const T& first) { return !c(key, first); }) - 1;
+	return searchBlock(b, [&c, &key](const T* first, const T* last) { return std::upper_bound(first, last, key, c); });
+}
+
+#endif
@@ -0,0 +1,246 @@
+#ifndef VARVECTOR_H
+#define VARVECTOR_H
+
+#include "vector.h"
+#include <algorithm>
+#include <stdexcept>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/* external vector of variable length elements: strings, blobs, serialized records
+ *
+ * the payloads are appended back to back to a heap, one byte stream over
+ * the data blocks of the file, so an element can start anywhere in a block
+ * and run on over as many blocks as it needs. where each one ends is kept
+ * in a vector<uint64_t> in <path>.off: element n is the bytes from the end
+ * of element n - 1 to offsets[n], found in O(1) with one offset lookup and
+ * a read of only the blocks it covers.
+ */
+
+class varvector
+{
+public:
+	typedef long long int size_type;
+private:
+	const size_t block_size;
+	BufferedFile* buffered_file;
+	vector<uint64_t>* offsets;
+	// end of the heap, the end of the last element
+	uint64_t heap_bytes;
+	// holds an element that crosses a block boundary while it is handed out
+	std::vector<char> scratch;
+
+	void writeHeap(uint64_t offset, const void* src, size_t size);
+	void readHeap(uint64_t offset, void* dst, size_t size);
+	// read through the const operator[], which works on read-only files too
+	uint64_t ends(size_type n) const { return ((const vector<uint64_t>&) *offsets)[n]; }
+	uint64_t begins(size_type n) const { return n == 0 ? 0 : ends(n - 1); }
+
+public:
+	varvector(const char* pathname, size_type blocksize, BufferedFile::OpenMode mode = BufferedFile::READ_WRITE);
+	~varvector();
+	varvector(const varvector&) = delete;
+	varvector& operator= (const varvector&) = delete;
+
+	size_type size() { return offsets->size(); }
+	bool empty() { return offsets->size() == 0; }
+	// bytes the payloads take in the heap
+	uint64_t heap_size() const { return heap_bytes; }
+
+	void push_back(const void* data, size_t length);
+	void push_back(const std::string& elem) { push_back(elem.data(), elem.size()); }
+	// n elements given as their payloads back to back in data and their lengths,
+	// written to the heap as one run
+	void append(const char* data, const uint64_t* lengths, size_type n);
+	template <typename InputIterator>
+	void append(InputIterator first, InputIterator last);
+	void pop_back();
+	void clear();
+
+	size_t length(size_type n);
+	// copies element n into out, which is only reallocated when it has to grow
+	void get(size_type n, std::string& out);
+	std::string operator[] (size_type n);
+
+	// calls fn(n, data, length) for every element in order. data points into the
+	// buffer pool, or into a scratch buffer for an element that crosses a block,
+	// and is only valid during the call.
+	template <typename Function>
+	void scan(Function fn, size_type first = 0);
+};
+
+varvector::varvector(const char* pathname, size_type blocksize, BufferedFile::OpenMode mode) : block_size(blocksize), heap_bytes(0)
+{
+	buffered_file = new BufferedFile(pathname, block_size, block_size*10, mode);
+	offsets = new vector<uint64_t>((std::string(pathname) + ".off").c_str(), blocksize, mode);
+
+	if(offsets->size() > 0)
+		heap_bytes = ends(offsets->size() - 1);
+
+	if((uint64_t) buffered_file->getLastBlock() * block_size < heap_bytes)
+	{
+		delete offsets;
+		delete buffered_file;
+		throw std::runtime_error{"Heap shorter than its offsets"};
+	}
+}
+
+varvector::~varvector()
+{
+	delete offsets;
+	delete buffered_file;
+}
+
+void varvector::writeHeap(uint64_t offset, const void* src, size_t size)
+{
+	const char* data = (const char*) src;
+	while(size > 0)
+	{
+		long block_number = 1 + offset / block_size;
+		size_t within = offset % block_size;
+		size_t chunk = std::min(size, block_size - within);
+
+		// the heap only ever grows at its end, so a new block is always the next one
+		BufferFrame* frame = block_number > buffered_file->getLastBlock() ? buffered_file->allotFrame() : buffered_file->readBlock(block_number);
+		BufferedFrameWriter::memcpy(frame, data, within, chunk);
+
+		data += chunk;
+		offset += chunk;
+		size -= chunk;
+	}
+}
+
+void varvector::readHeap(uint64_t offset, void* dst, size_t size)
+{
+	char* data = (char*) dst;
+	while(size > 0)
+	{
+		long block_number = 1 + offset / block_size;
+		size_t within = offset % block_size;
+		size_t chunk = std::min(size, block_size - within);
+
+		BufferFrame* frame = buffered_file->readBlock(block_number);
+		std::memcpy(data, BufferedFrameReader::readRawData(frame, within), chunk);
+
+		data += chunk;
+		offset += chunk;
+		size -= chunk;
+	}
+}
+
+void varvector::push_back(const void* data, size_t length)
+{
+	writeHeap(heap_bytes, data, length);
+	heap_bytes += length;
+	offsets->push_back(heap_bytes);
+}
+
+void varvector::append(const char* data, const uint64_t* lengths, size_type n)
+{
+	std::vector<uint64_t> ends(n);
+	uint64_t end = heap_bytes;
+	for(size_type i = 0; i < n; i++)
+		ends[i] = (end += lengths[i]);
+
+	writeHeap(heap_bytes, data, end - heap_bytes);
+	heap_bytes = end;
+	offsets->append(ends.data(), n);
+}
+
+template <typename InputIterator>
+void varvector::append(InputIterator first, InputIterator last)
+{
+	for(; first != last; ++first)
+		push_back(*first);
+}
+
+void varvector::pop_back()
+{
+	if(offsets->size() == 0)
+		throw std::out_of_range{"varvector::pop_back()"};
+
+	offsets->pop_back();
+	heap_bytes = begins(offsets->size());
+}
+
+void varvector::clear()
+{
+	offsets->clear();
+	buffered_file->deleteBlock(1);
+	heap_bytes = 0;
+}
+
+size_t varvector::length(size_type n)
+{
+	if(n >= offsets->size() || n < 0)
+		throw std::out_of_range{"varvector::length()"};
+	return ends(n) - begins(n);
+}
+
+void varvector::get(size_type n, std::string& out)
+{
+	if(n >= offsets->size() || n < 0)
+		throw std::out_of_range{"varvector::get()"};
+
+	uint64_t start = begins(n);
+	out.resize(ends(n) - start);
+	if(!out.empty())
+		readHeap(start, &out[0], out.size());
+}
+
+std::string varvector::operator[] (size_type n)
+{
+	std::string elem;
+	get(n, elem);
+	return elem;
+}
+
+template <typename Function>
+void varvector::scan(Function fn, size_type first)
+{
+	// the heap is read ahead in runs of this many blocks
+	const long prefetch_blocks = 64;
+	long prefetched = 0;
+
+	uint64_t start = begins(std::min(first, offsets->size()));
+	size_type n = 0;
+	for(auto span : offsets->cblocks())
+	{
+		if(n + span.size() <= first)
+		{
+			n += span.size();
+			continue;
+		}
+
+		for(size_type i = std::max((size_type) 0, first - n); i < span.size(); i++)
+		{
+			uint64_t end = span[i];
+			size_t length = end - start;
+			long block_number = 1 + start / block_size;
+			size_t within = start % block_size;
+
+			if(block_number + prefetch_blocks / 2 > prefetched)
+			{
+				long from = std::max(prefetched + 1, block_number);
+				buffered_file->prefetchBlocks(from, block_number + prefetch_blocks - from);
+				prefetched = block_number + prefetch_blocks - 1;
+			}
+
+			if(length > 0 && within + length <= block_size)
+				fn(n + i, (const char*) BufferedFrameReader::readRawData(buffered_file->readBlock(block_number), within), length);
+			else
+			{
+				if(scratch.size() < length)
+					scratch.resize(length);
+				readHeap(start, scratch.data(), length);
+				fn(n + i, (const char*) scratch.data(), length);
+			}
+			start = end;
+		}
+		n += span.size();
+	}
+}
+
+#endif
@@ -1,30 +1,127 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
 #include "buffer.h"
+#include "kernels.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <future>
 #include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <stddef.h>
 
-template <typename T>
+// per-vector tuning of the buffer pool and of how the file is read
+struct vector_options
+{
+	// buffer pool size in bytes, 0 sizes it from the memory currently available
+	size_t pool_memory;
+	// blocks sequential scans load ahead in one go, 0 for the default. never more than half the pool.
+	long read_ahead_blocks;
+	// also let the kernel start on the run after the one read ahead
+	bool prefetch;
+	// POSIX_FADV_* advice for the whole file
+	int access_hint;
+	BufferedFile::OpenMode mode;
+	
+	static const long default_read_ahead_blocks = 64;
+	
+	vector_options() : pool_memory(0), read_ahead_blocks(0), prefetch(true), access_hint(POSIX_FADV_NORMAL), mode(BufferedFile::READ_WRITE) {}
+	
+	// an eighth of the free physical memory, at least ten blocks and at most 1GB
+	size_t poolMemory(size_t block_size) const
+	{
+		if(pool_memory != 0)
+			return std::max(pool_memory, block_size);
+		
+		long pages = sysconf(_SC_AVPHYS_PAGES);
+		long page_size = sysconf(_SC_PAGESIZE);
+		size_t available = (pages > 0 && page_size > 0) ? (size_t) pages * page_size : 0;
+		return std::min(std::max(available / 8, block_size * 10), (size_t) 1 << 30);
+	}
+};
+
+const long vector_options::default_read_ahead_blocks;
+
+template <typename T, size_t BlockSize = 0>
 class vector
 {
 public:
 	typedef long long int size_type;
 private:
 	const size_t block_size;
-	const size_t element_size;
+	static const size_t element_size = sizeof(T);
 	const size_t num_elements_per_block;
 	BufferedFile* buffered_file;
 	size_type sz;
+	// blocks set aside by reserve(), they keep their disk space across close
+	long reserved_blocks;
+	long read_ahead_blocks;
+	bool prefetch;
+	
+	// with a BlockSize the block geometry is known at compile time, and for a
+	// power of two elements per block the index math comes down to shifts and masks
+	static_assert(BlockSize == 0 || BlockSize >= sizeof(T), "vector<T, BlockSize>: block smaller than an element");
+	size_t perBlock() const { return BlockSize ? BlockSize / sizeof(T) : num_elements_per_block; }
+	
+	// the block an iterator last dereferenced. nothing is pinned: the frame is
+	// used again only while it still holds that block, so stepping through the
+	// rest of the block needs no buffer lookup and a cursor never outlives its
+	// frame's pin or touches the pool when it goes away.
+	struct block_cursor {
+		BufferFrame* frame;
+		long block_number;
+		size_type first, last;
+		
+		block_cursor() : frame(nullptr), block_number(-1), first(0), last(0) {}
+	};
+	
+	BufferFrame* cursorBlock(block_cursor& cursor, size_type n);
+	// loads a run of blocks from block_number on, unless it is cached already
+	void readAhead(long block_number);
+	
+	// runs fn(task, data, count) on every block, a chunk of blocks per task on a
+	// work-stealing pool. each worker reads its chunks straight from the file into
+	// a private buffer, and with write_back writes back the blocks fn changed.
+	template <typename BlockFn>
+	void parallelBlocks(BlockFn fn, bool write_back, int threads);
+	
+	// the parallel algorithms' worker threads, started on first use and kept
+	std::unique_ptr<WorkStealingPool> pool;
+	int pool_threads;
+	WorkStealingPool& workerPool(int threads);
+	
+	// calls fn(frame, offset, i) for every indices[i], visiting the blocks in disk order
+	template <typename ElementFn>
+	void visitIndices(const std::vector<size_type>& indices, ElementFn fn);
+	
+	// the plain constructor's pool of ten blocks
+	static vector_options legacyOptions(size_type blocksize, BufferedFile::OpenMode mode)
+	{
+		vector_options options;
+		options.pool_memory = blocksize * 10;
+		options.mode = mode;
+		return options;
+	}
+	
+	static T* spanData(BufferFrame* frame, T*) { return BufferedFrameReader::readPtr<T>(frame, 0); }
+	static const T* spanData(BufferFrame* frame, const T*) { return (const T*) BufferedFrameReader::readRawData(frame, 0); }
 
 public:
 	class iterator : public std::iterator<std::random_access_iterator_tag, T, size_type, T*, T&> {
 	friend class vector;
 	private:
 		size_type index;
-		vector<T>* vec;
+		vector<T, BlockSize>* vec;
+		block_cursor cursor;
 	public:
-		iterator(size_type i, vector<T>* v) : index(i), vec(v) {}
-		iterator(const iterator& it) : index(it.index), vec(it.vec) {}
-		iterator(vector<T>* v) : index(0), vec(v) {}
+		iterator(size_type i, vector<T, BlockSize>* v) : index(i), vec(v) {}
+		iterator(const iterator& it) : index(it.index), vec(it.vec), cursor(it.cursor) {}
+		iterator(vector<T, BlockSize>* v) : index(0), vec(v) {}
 		iterator() : index(0), vec(nullptr) {}
 		bool operator== (const iterator& rhs) { return (index == rhs.index) || (index>=vec->sz && rhs.index>=vec->sz) || (index<0 || rhs.index<0); }
 		bool operator!= (const iterator& rhs) { return !(operator==(rhs)); }
@@ -49,11 +146,12 @@ public:
 	friend class vector;
 	private:
 		size_type index;
-		vector<T>* vec;
+		vector<T, BlockSize>* vec;
+		mutable block_cursor cursor;
 	public:
-		const_iterator(size_type i, vector<T>* v) : index(i), vec(v) {}
-		const_iterator(const iterator& it) : index(it.index), vec(it.vec) {}
-		const_iterator(vector<T>* v) : index(0), vec(v) {}
+		const_iterator(size_type i, vector<T, BlockSize>* v) : index(i), vec(v) {}
+		const_iterator(const iterator& it) : index(it.index), vec(it.vec), cursor(it.cursor) {}
+		const_iterator(vector<T, BlockSize>* v) : index(0), vec(v) {}
 		const_iterator() : index(0), vec(nullptr) {}
 		bool operator== (const const_iterator& rhs) { return (index == rhs.index) || (index>=vec->sz && rhs.index>=vec->sz) || (index<0 && rhs.index<0); }
 		bool operator!= (const const_iterator& rhs) { return !(operator==(rhs)); }
@@ -78,11 +176,12 @@ public:
 	friend class vector;
 	private:
 		size_type index;
-		vector<T>* vec;
+		vector<T, BlockSize>* vec;
+		block_cursor cursor;
 	public:
-		reverse_iterator(size_type i, vector<T>* v) : index(i), vec(v) {}
-		reverse_iterator(const reverse_iterator& it) : index(it.index), vec(it.vec) {}
-		reverse_iterator(vector<T>* v) : index(v->sz-1), vec(v) {}
+		reverse_iterator(size_type i, vector<T, BlockSize>* v) : index(i), vec(v) {}
+		reverse_iterator(const reverse_iterator& it) : index(it.index), vec(it.vec), cursor(it.cursor) {}
+		reverse_iterator(vector<T, BlockSize>* v) : index(v->sz-1), vec(v) {}
 		reverse_iterator() : index(-1), vec(nullptr) {}
 		bool operator== (const reverse_iterator& rhs) { return (index == rhs.index) || (index>=vec->sz && rhs.index>=vec->sz) || (index<0 && rhs.index<0); }
 		bool operator!= (const reverse_iterator& rhs) { return !(operator==(rhs)); }
@@ -103,29 +202,292 @@ public:
 		typename std::iterator<std::random_access_iterator_tag, T, long long int, T*, T&>::difference_type operator- (const reverse_iterator& rhs) { return -index+rhs.index; }
 	};
 
-	vector(const char* pathname, size_type blocksize) : block_size(blocksize), element_size(sizeof(T)),
-		sz(0), num_elements_per_block(blocksize/(sizeof(T))) {
-		buffered_file = new BufferedFile(pathname, block_size, block_size*10);
+	// the elements of one block, contiguous in memory
+	template <typename U>
+	class block_span {
+	private:
+		U* ptr;
+		size_type count;
+	public:
+		block_span(U* p, size_type n) : ptr(p), count(n) {}
+		U* data() const { return ptr; }
+		size_type size() const { return count; }
+		U* begin() const { return ptr; }
+		U* end() const { return ptr + count; }
+		U& operator[] (size_type n) const { return ptr[n]; }
+	};
+	
+	// walks the vector one block at a time. like a reference from operator[], a
+	// span is valid until the vector reads another block.
+	template <typename U>
+	class basic_block_iterator : public std::iterator<std::forward_iterator_tag, block_span<U> > {
+	friend class vector;
+	private:
+		long block;
+		vector<T, BlockSize>* vec;
+		mutable block_cursor cursor;
+	public:
+		basic_block_iterator(long b, vector<T, BlockSize>* v) : block(b), vec(v) {}
+		basic_block_iterator() : block(0), vec(nullptr) {}
+		bool operator== (const basic_block_iterator& rhs) const { return block == rhs.block; }
+		bool operator!= (const basic_block_iterator& rhs) const { return block != rhs.block; }
+		block_span<U> operator* () const;
+		basic_block_iterator& operator++ () { block++; return *this; }
+		basic_block_iterator operator++(int) { basic_block_iterator tmp(*this); operator++(); return tmp; }
+		basic_block_iterator operator+ (long n) const { return basic_block_iterator(block + n, vec); }
+		// index of the block's first element
+		size_type first_index() const { return block * (size_type) vec->perBlock(); }
+	};
+	
+	typedef block_span<T> span;
+	typedef block_span<const T> const_span;
+	typedef basic_block_iterator<T> block_iterator;
+	typedef basic_block_iterator<const T> const_block_iterator;
+	
+	template <typename Iter>
+	class block_range {
+	private:
+		Iter first, last;
+	public:
+		block_range(Iter f, Iter l) : first(f), last(l) {}
+		Iter begin() const { return first; }
+		Iter end() const { return last; }
+	};
+
+	// sequential writer that bypasses the buffer pool. elements are gathered
+	// in num_buffers private block-aligned buffers of buffer_blocks blocks;
+	// a full buffer is written out by the writer's own background thread
+	// while the next one fills. size and header are updated on close(), which
+	// is the call that reports write errors: the destructor closes too, but
+	// swallows them. the vector must not be used otherwise while a stream is open.
+	class stream_writer {
+	private:
+		vector<T, BlockSize>* vec;
+		long buffer_blocks;
+		std::vector<char*> buffers;
+		std::vector< std::future<void> > pending;
+		BackgroundWorker io;
+		int current;
+		long first_block;	// where the current buffer goes
+		size_type index;	// elements in the current buffer
+		size_type total;
+		bool closed;
+		
+		void submit();
+	public:
+		stream_writer(vector<T, BlockSize>& v, int num_buffers = 4, long buffer_blocks = 64);
+		~stream_writer();
+		stream_writer(const stream_writer&) = delete;
+		stream_writer& operator= (const stream_writer&) = delete;
+		
+		void push(const T& elem);
+		stream_writer& operator<< (const T& elem) { push(elem); return *this; }
+		void close();
+	};
+	
+	// sequential reader that bypasses the buffer pool, the next num_buffers
+	// chunks of buffer_blocks blocks are always being read by a background thread
+	class stream_reader {
+	private:
+		vector<T, BlockSize>* vec;
+		long buffer_blocks;
+		std::vector<char*> buffers;
+		std::vector< std::future<void> > pending;
+		BackgroundWorker io;
+		int current;
+		long next_block;	// first block not handed to a buffer yet
+		size_type index, end_index;
+		size_type slot;		// index's place in the current buffer
+		
+		void fetch(int buffer);
+	public:
+		stream_reader(vector<T, BlockSize>& v, size_type first = 0, int num_buffers = 4, long buffer_blocks = 64);
+		~stream_reader();
+		stream_reader(const stream_reader&) = delete;
+		stream_reader& operator= (const stream_reader&) = delete;
+		
+		bool empty() const { return index >= end_index; }
+		const T& operator* () const { return *(const T*) (buffers[current] + (slot / vec->perBlock()) * vec->block_size + (slot % vec->perBlock()) * vec->element_size); }
+		stream_reader& operator++ ();
+		stream_reader& operator>> (T& elem) { elem = **this; return ++(*this); }
+	};
+
+	// appends from many threads at once. every thread takes its own producer,
+	// which gathers elements in a private buffer of buffer_blocks blocks. a full
+	// buffer reserves its index range with one atomic add and is written
+	// straight to its place in the file, so producers never wait on each other
+	// for I/O. size() is the committed watermark: every element below it is
+	// on disk and read() gets it from any thread. the vector must not be used
+	// otherwise until close(), which throws while a producer still holds
+	// elements it has not flushed. the destructors never throw, call flush()
+	// and close() to hear about a failure.
+	class concurrent_appender {
+	public:
+		class producer {
+		private:
+			concurrent_appender* owner;
+			size_t buffer_elems;
+			std::vector<T> elems;
+			// elems laid out as in the blocks they go to
+			std::vector<char> staging;
+		public:
+			producer(concurrent_appender& a) : owner(&a), buffer_elems(a.buffer_blocks * a.vec->perBlock()) { elems.reserve(buffer_elems); }
+			~producer();
+			producer(const producer&) = delete;
+			producer& operator= (const producer&) = delete;
+			
+			void push(const T& elem);
+			producer& operator<< (const T& elem) { push(elem); return *this; }
+			void append(const T* first, size_type n);
+			// publishes what is gathered so far
+			void flush();
+		};
+		
+	private:
+		vector<T, BlockSize>* vec;
+		long buffer_blocks;
+		long first_block;	// the first block producers may write to
+		std::atomic<size_type> reserved;
+		std::atomic<size_type> committed;
+		// ranges written while one before them still is not, by first index
+		std::map<size_type, size_type> finished;
+		std::mutex finished_lock;
+		// producers with elements gathered but not flushed
+		std::atomic<long> holding;
+		std::atomic<bool> closed;
+		
+		void commit(size_type first, size_type last);
+	public:
+		concurrent_appender(vector<T, BlockSize>& v, long buffer_blocks = 16);
+		~concurrent_appender();
+		concurrent_appender(const concurrent_appender&) = delete;
+		concurrent_appender& operator= (const concurrent_appender&) = delete;
+		
+		size_type size() const { return committed.load(std::memory_order_acquire); }
+		// copies elements first to first + n - 1, all below size(), into out
+		void read(size_type first, size_type n, T* out) const;
+		void close();
+	};
+
+	// gathers inserts and erases, all addressed by position in the vector as it
+	// was when the batch began, and applies them together in one pass over the
+	// blocks from the first edited one on. k scattered edits then cost O(n + k)
+	// I/O instead of k shifts of the file tail. elements that still have to be
+	// read when their place is written over wait in memory, at most one block
+	// more than the inserts. the vector must not be changed otherwise while
+	// edits are pending. call apply() to carry them out, the destructor applies
+	// what is left but swallows any exception, so a failure there goes unseen.
+	class batch_edit {
+	private:
+		struct insertion {
+			size_type pos;
+			T value;
+		};
+		
+		vector<T, BlockSize>* vec;
+		std::vector<insertion> inserts;
+		// first and last element of every erase, both included
+		std::vector< std::pair<size_type, size_type> > erases;
+	public:
+		batch_edit(vector<T, BlockSize>& v) : vec(&v) {}
+		~batch_edit();
+		batch_edit(const batch_edit&) = delete;
+		batch_edit& operator= (const batch_edit&) = delete;
+		
+		// elem goes before element pos, or at the end for pos == size(). inserts at one
+		// position keep the order they were made in, and survive erasing that element.
+		void insert(size_type pos, const T& elem);
+		template <typename InputIterator>
+		void insert(size_type pos, InputIterator first, InputIterator last);
+		// removes elements first to last, both included, like vector<T>::erase
+		void erase(size_type first, size_type last);
+		void erase(size_type pos) { erase(pos, pos); }
+		
+		size_type pending() const { return inserts.size() + erases.size(); }
+		void apply();
+	};
+
+	// blocks handed to one parallel task
+	static const long parallel_chunk_blocks = 64;
+
+	// a vector<T, BlockSize> must be opened with that block size, blocksize can be left out.
+	// open with BufferedFile::READ_ONLY to share the file with other reading processes.
+	vector(const char* pathname, size_type blocksize = BlockSize, BufferedFile::OpenMode mode = BufferedFile::READ_WRITE) :
+		vector(pathname, blocksize, legacyOptions(blocksize, mode)) {}
+	
+	vector(const char* pathname, size_type blocksize, const vector_options& options) : block_size(blocksize),
+		num_elements_per_block(blocksize/(sizeof(T))), sz(0), reserved_blocks(0) {
+		if(blocksize < (size_type) sizeof(T) || (BlockSize != 0 && blocksize != (size_type) BlockSize))
+			throw std::invalid_argument{"vector<T>: block size does not fit"};
+		
+		buffered_file = new BufferedFile(pathname, block_size, options.poolMemory(block_size), options.mode);
+		
+		read_ahead_blocks = options.read_ahead_blocks > 0 ? options.read_ahead_blocks : vector_options::default_read_ahead_blocks;
+		read_ahead_blocks = std::min(read_ahead_blocks, (long) buffered_file->getPoolSize() / 2);
+		prefetch = options.prefetch;
+		if(options.access_hint != POSIX_FADV_NORMAL)
+			buffered_file->adviseAccess(options.access_hint);
 		
 		// dirty way to decode the header. reading size from header.
 		BufferFrame* header = buffered_file->readHeader();
 		sz = BufferedFrameReader::read<size_type>(header, sizeof(long));
+		reserved_blocks = BufferedFrameReader::read<long>(header, sizeof(long) + sizeof(size_type));
+		
+		// files from before reserve() have garbage here. a real reservation was kept
+		// on disk at close, so it never runs past the end of the file.
+		if(reserved_blocks < 0 || reserved_blocks > buffered_file->getReservedBlocks())
+			reserved_blocks = 0;
+		
+		if(reserved_blocks > 0 && !buffered_file->isReadOnly())
+			buffered_file->keepBlocks(reserved_blocks);
 	}
 	
 	~vector()
 	{
 		// update size of vector in header.
-		BufferedFrameWriter::write<size_type>(buffered_file->readHeader(), sizeof(long), sz);
-		buffered_file->writeHeader();
+		if(!buffered_file->isReadOnly())
+		{
+			BufferedFrameWriter::write<size_type>(buffered_file->readHeader(), sizeof(long), sz);
+			BufferedFrameWriter::write<long>(buffered_file->readHeader(), sizeof(long) + sizeof(size_type), reserved_blocks);
+			buffered_file->writeHeader();
+		}
 		
 		delete buffered_file;
 	}
 	
 	size_type size() { return sz; }
+	// elements that fit in the blocks the file already has disk space for
+	size_type capacity() const { return std::max((long) num_blocks(), buffered_file->getReservedBlocks()) * (size_type) perBlock(); }
+	size_type elements_per_block() const { return perBlock(); }
+	long num_blocks() const { return (sz + perBlock() - 1) / perBlock(); }
+	
+	// for(auto span : vec.blocks()) hands out every block as a span of up to
+	// elements_per_block() elements
+	block_range<block_iterator> blocks() { return block_range<block_iterator>(block_iterator(0, this), block_iterator(num_blocks(), this)); }
+	block_range<const_block_iterator> cblocks() { return block_range<const_block_iterator>(const_block_iterator(0, this), const_block_iterator(num_blocks(), this)); }
+	// block b of cblocks() on its own, for point lookups: unlike the block iterators it never reads ahead
+	block_span<const T> cblock(long b);
+	// blocks read from the file into the buffer pool so far
+	long blocks_read() const { return buffered_file->getBlocksRead(); }
 	
 	void push_back(const T& elem);
 	void pop_back();
 	
+	// bulk versions of push_back, filling a whole block per buffer lookup
+	template <typename InputIterator>
+	void append(InputIterator first, InputIterator last);
+	void append(const T* elems, size_type n);
+	template <typename InputIterator>
+	void assign(InputIterator first, InputIterator last);
+	void assign(const T* elems, size_type n);
+	
+	// preallocates disk space for n elements, so growing up to n does no filesystem work
+	void reserve(size_type n);
+	// new elements are set to value, written a whole block at a time
+	void resize(size_type n, const T& value = T());
+	// frees the blocks past the last element and drops any reservation
+	void shrink_to_fit();
+	
 	void clear();
 	void erase(iterator start, iterator end);
 	
@@ -134,7 +496,34 @@ public:
 	template <typename InputIterator>
 	void insert(iterator pos, InputIterator first, InputIterator last);
 	
+	// throws on a read-only vector, whose elements are read through the const overload
 	T& operator[] (size_type n);
+	const T& operator[] (size_type n) const;
+	
+	// out[i] = (*this)[indices[i]] and (*this)[indices[i]] = values[i], for any order of
+	// indices. every block is read once, the blocks in disk order and batched through
+	// BufferedFile::readBlocks(). a repeated index in scatter keeps the last value.
+	void gather(const std::vector<size_type>& indices, std::vector<T>& out);
+	void scatter(const std::vector<size_type>& indices, const std::vector<T>& values);
+	
+	// whole-vector kernels run block by block, vectorised for arithmetic T (see kernels.h)
+	typename BlockKernels<T>::sum_type sum();
+	std::pair<T, T> minmax();
+	size_type count(const T& value);
+	iterator find(const T& value);
+	// bins equal-width bins over [lo, hi)
+	std::vector<long long> histogram(const T& lo, const T& hi, size_t bins);
+	
+	// parallel algorithms, threads = 0 uses every hardware thread.
+	// f and op must be safe to call concurrently, reduce and scan need an associative op.
+	template <typename Function>
+	void parallel_for_each(Function f, int threads = 0);
+	template <typename UnaryOp>
+	void parallel_transform(UnaryOp op, int threads = 0);
+	template <typename BinaryOp>
+	T parallel_reduce(T init, BinaryOp op, int threads = 0);
+	template <typename BinaryOp>
+	void parallel_inclusive_scan(BinaryOp op, int threads = 0);
 	
 	iterator begin();
 	iterator end();
@@ -144,16 +533,21 @@ public:
 	reverse_iterator rend();
 };
 
-template <typename T>
-void vector<T>::push_back(const T& elem) {
-	long block_number = (sz / num_elements_per_block) + 1;
-	long block_offset = (sz % num_elements_per_block) * element_size;
+template <typename T, size_t BlockSize>
+const size_t vector<T, BlockSize>::element_size;
+
+template <typename T, size_t BlockSize>
+const long vector<T, BlockSize>::parallel_chunk_blocks;
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::push_back(const T& elem) {
+	long block_number = (sz / perBlock()) + 1;
+	long block_offset = (sz % perBlock()) * element_size;
 	
 	BufferFrame* disk_block;
 	
 	if(block_offset==0) {
-		long new_block = buffered_file->allotBlock();
-		disk_block = buffered_file->readBlock(new_block);
+		disk_block = buffered_file->allotFrame();
 	} else {
 		disk_block = buffered_file->readBlock(block_number);
 	}
@@ -163,41 +557,450 @@ void vector<T>::push_back(const T& elem) {
 	sz++;
 }
 
-template <typename T>
-void vector<T>::pop_back() {
-	if(sz>0)
-		sz--;
+template <typename T, size_t BlockSize>
+template <typename InputIterator>
+void vector<T, BlockSize>::append(InputIterator first, InputIterator last) {
+	while(first != last)
+	{
+		long block_offset = sz % perBlock();
+		BufferFrame* disk_block;
+		
+		if(block_offset == 0)
+			disk_block = buffered_file->allotFrame();
+		else
+			disk_block = buffered_file->readBlock((sz / perBlock()) + 1);
+		
+		T* slot = BufferedFrameReader::readPtr<T>(disk_block, block_offset * element_size);
+		size_type room = perBlock() - block_offset;
+		size_type filled = 0;
+		
+		while(filled < room && first != last)
+		{
+			slot[filled++] = *first;
+			++first;
+		}
+		sz += filled;
+	}
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::append(const T* elems, size_type n) {
+	// top up the last block through the pool
+	long block_offset = sz % perBlock();
+	if(block_offset != 0 && n > 0)
+	{
+		size_type count = std::min(n, (size_type) (perBlock() - block_offset));
+		BufferFrame* disk_block = buffered_file->readBlock((sz / perBlock()) + 1);
+		BufferedFrameWriter::memcpy(disk_block, elems, block_offset * element_size, count * element_size);
+		elems += count;
+		n -= count;
+		sz += count;
+	}
+	
+	// when blocks hold no padding the source is laid out exactly like the file,
+	// so whole blocks are written out in one go without going through the pool
+	long full_blocks = n / perBlock();
+	if(full_blocks > 0 && perBlock() * element_size == block_size)
+	{
+		long first_block = buffered_file->allotBlock();
+		for(long i = 1; i < full_blocks; i++)
+			buffered_file->allotBlock();
+		
+		buffered_file->writeBlocksDirect(first_block, full_blocks, elems);
+		
+		elems += full_blocks * perBlock();
+		n -= full_blocks * perBlock();
+		sz += full_blocks * perBlock();
+	}
+	
+	while(n > 0)
+	{
+		size_type count = std::min(n, (size_type) perBlock());
+		BufferFrame* disk_block = buffered_file->allotFrame();
+		BufferedFrameWriter::memcpy(disk_block, elems, 0, count * element_size);
+		elems += count;
+		n -= count;
+		sz += count;
+	}
+}
+
+template <typename T, size_t BlockSize>
+template <typename InputIterator>
+void vector<T, BlockSize>::assign(InputIterator first, InputIterator last) {
+	clear();
+	append(first, last);
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::assign(const T* elems, size_type n) {
+	clear();
+	append(elems, n);
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::reserve(vector<T, BlockSize>::size_type n) {
+	long blocks = (n + perBlock() - 1) / perBlock();
+	if(blocks <= reserved_blocks)
+		return;
+	
+	reserved_blocks = blocks;
+	buffered_file->keepBlocks(reserved_blocks);
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::resize(vector<T, BlockSize>::size_type n, const T& value) {
+	if(n < 0)
+		throw std::length_error{"vector<T>::resize()"};
 	
-	if( sz % num_elements_per_block == 0 )
+	if(n <= sz)
 	{
-		buffered_file->deleteBlock( (sz/num_elements_per_block) + 1 );
+		long blocks = (n + perBlock() - 1) / perBlock();
+		long offset = n % perBlock();
+		
+		// the dropped part of the last kept block reads back as zeros, like after erase()
+		if(offset != 0 && n < sz)
+		{
+			long end = std::min(sz - (blocks - 1) * (size_type) perBlock(), (size_type) perBlock());
+			BufferedFrameWriter::memset(buffered_file->readBlock(blocks), 0, offset * element_size, (end - offset) * element_size);
+		}
+		if(blocks < num_blocks())
+			buffered_file->deleteBlock(blocks + 1);
+		sz = n;
+		return;
 	}
+	
+	// one fallocate up front instead of one per preallocation step
+	buffered_file->reserveBlocks((n + perBlock() - 1) / perBlock());
+	
+	size_type fill = std::min(n - sz, (size_type) (parallel_chunk_blocks * perBlock()));
+	std::vector<T> values(fill, value);
+	while(sz < n)
+		append(values.data(), std::min(n - sz, fill));
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::shrink_to_fit() {
+	reserved_blocks = 0;
+	if(buffered_file->getLastBlock() > num_blocks())
+		buffered_file->deleteBlock(num_blocks() + 1);
+	buffered_file->trimBlocks();
 }
 
-template <typename T>
-void vector<T>::clear() {
-	for(auto i = (sz/num_elements_per_block) + 1; i > 0; i--)
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::pop_back() {
+	if(sz>0)
+		sz--;
+	
+	if( sz % perBlock() == 0 )
 	{
-		buffered_file->deleteBlock(i);
+		buffered_file->deleteBlock( (sz/perBlock()) + 1 );
 	}
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::clear() {
+	buffered_file->deleteBlock(1);
 	sz = 0;
 }
 
-template <typename T>
-T& vector<T>::operator[] (vector<T>::size_type n) {
+template <typename T, size_t BlockSize>
+T& vector<T, BlockSize>::operator[] (vector<T, BlockSize>::size_type n) {
 	if(n >= sz)
 		throw std::out_of_range{"vector<T>::operator[]"};
 
-	long block_number = (n / num_elements_per_block) + 1;
-	long block_offset = (n % num_elements_per_block) * element_size;
+	long block_number = (n / perBlock()) + 1;
+	long block_offset = (n % perBlock()) * element_size;
 	
 	BufferFrame* buff = buffered_file->readBlock(block_number);
 	
 	return *(BufferedFrameReader::readPtr<T>(buff, block_offset));
 }
 
-template <typename T>
-void vector<T>::erase(vector<T>::iterator start, vector<T>::iterator end)
+template <typename T, size_t BlockSize>
+const T& vector<T, BlockSize>::operator[] (vector<T, BlockSize>::size_type n) const {
+	if(n >= sz)
+		throw std::out_of_range{"vector<T>::operator[]"};
+
+	long block_number = (n / perBlock()) + 1;
+	long block_offset = (n % perBlock()) * element_size;
+	
+	BufferFrame* buff = buffered_file->readBlock(block_number);
+	
+	return *((const T*) BufferedFrameReader::readRawData(buff, block_offset));
+}
+
+template <typename T, size_t BlockSize>
+template <typename ElementFn>
+void vector<T, BlockSize>::visitIndices(const std::vector<size_type>& indices, ElementFn fn) {
+	for(size_t i = 0; i < indices.size(); i++)
+	{
+		if(indices[i] >= sz || indices[i] < 0)
+			throw std::out_of_range{"vector<T>::gather/scatter"};
+	}
+	
+	// stable, so equal indices are visited in the order given
+	std::vector<size_t> order(indices.size());
+	for(size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return indices[a] < indices[b]; });
+	
+	// at most half the pool is pinned by one batch, as in BlockScheduler
+	size_t batch = std::max(buffered_file->getPoolSize() / 2, 1);
+	size_t next = 0;
+	while(next < order.size())
+	{
+		std::vector<long> block_numbers;
+		size_t end = next;
+		while(end < order.size())
+		{
+			long block_number = (indices[order[end]] / perBlock()) + 1;
+			if(block_numbers.empty() || block_numbers.back() != block_number)
+			{
+				if(block_numbers.size() == batch)
+					break;
+				block_numbers.push_back(block_number);
+			}
+			end++;
+		}
+		
+		std::vector<BufferFrame*> frames = buffered_file->readBlocks(block_numbers);
+		size_t frame = 0;
+		for(size_t k = next; k < end; k++)
+		{
+			size_type n = indices[order[k]];
+			while(block_numbers[frame] != (long) (n / perBlock()) + 1)
+				frame++;
+			fn(frames[frame], (n % perBlock()) * element_size, order[k]);
+		}
+		
+		for(auto f : frames)
+			f->unpin();
+		next = end;
+	}
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::gather(const std::vector<size_type>& indices, std::vector<T>& out) {
+	out.resize(indices.size());
+	visitIndices(indices, [&](BufferFrame* frame, size_t offset, size_t i) {
+		out[i] = BufferedFrameReader::read<T>(frame, offset);
+	});
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::scatter(const std::vector<size_type>& indices, const std::vector<T>& values) {
+	if(values.size() != indices.size())
+		throw std::length_error{"vector<T>::scatter()"};
+	
+	visitIndices(indices, [&](BufferFrame* frame, size_t offset, size_t i) {
+		BufferedFrameWriter::write<T>(frame, offset, values[i]);
+	});
+}
+
+template <typename T, size_t BlockSize>
+typename BlockKernels<T>::sum_type vector<T, BlockSize>::sum() {
+	typename BlockKernels<T>::sum_type total = 0;
+	for(auto span : cblocks())
+		total += BlockKernels<T>::sum(span.data(), span.size());
+	return total;
+}
+
+template <typename T, size_t BlockSize>
+std::pair<T, T> vector<T, BlockSize>::minmax() {
+	if(sz == 0)
+		throw std::out_of_range{"vector<T>::minmax()"};
+	
+	T lo = (*this)[0], hi = lo;
+	for(auto span : cblocks())
+		BlockKernels<T>::minmax(span.data(), span.size(), lo, hi);
+	return std::make_pair(lo, hi);
+}
+
+template <typename T, size_t BlockSize>
+typename vector<T, BlockSize>::size_type vector<T, BlockSize>::count(const T& value) {
+	size_type found = 0;
+	for(auto span : cblocks())
+		found += BlockKernels<T>::count(span.data(), span.size(), value);
+	return found;
+}
+
+template <typename T, size_t BlockSize>
+typename vector<T, BlockSize>::iterator vector<T, BlockSize>::find(const T& value) {
+	for(const_block_iterator block = cblocks().begin(); block != cblocks().end(); ++block)
+	{
+		const_span span = *block;
+		size_t pos = BlockKernels<T>::find(span.data(), span.size(), value);
+		if(pos < (size_t) span.size())
+			return iterator(block.first_index() + pos, this);
+	}
+	return end();
+}
+
+template <typename T, size_t BlockSize>
+std::vector<long long> vector<T, BlockSize>::histogram(const T& lo, const T& hi, size_t bins) {
+	std::vector<long long> counts(bins, 0);
+	if(bins == 0 || !(lo < hi))
+		return counts;
+	
+	for(auto span : cblocks())
+		BlockKernels<T>::histogram(span.data(), span.size(), lo, hi, counts);
+	return counts;
+}
+
+template <typename T, size_t BlockSize>
+template <typename BlockFn>
+void vector<T, BlockSize>::parallelBlocks(BlockFn fn, bool write_back, int threads) {
+	long total_blocks = num_blocks();
+	if(total_blocks == 0)
+		return;
+	
+	// the workers bypass the pool, so it must hold nothing newer than the file,
+	// and nothing that goes stale once the workers write
+	if(write_back)
+		buffered_file->evictBlocks(1, total_blocks);
+	else
+		buffered_file->flush();
+	
+	long tasks = (total_blocks + parallel_chunk_blocks - 1) / parallel_chunk_blocks;
+	WorkStealingPool& workers = workerPool(threads);
+	std::vector< std::vector<char> > buffers(workers.size(), std::vector<char>(parallel_chunk_blocks * block_size));
+	// what was read, so only the blocks fn changed are written back
+	std::vector< std::vector<char> > originals(write_back ? workers.size() : 0, std::vector<char>(parallel_chunk_blocks * block_size));
+	
+	workers.run(tasks, [&](long task, int worker) {
+		long first_block = task * parallel_chunk_blocks + 1;
+		long count = std::min(parallel_chunk_blocks, total_blocks - first_block + 1);
+		char* buffer = buffers[worker].data();
+		
+		// a worker's next task is usually the following chunk
+		if(task + 1 < tasks)
+			buffered_file->prefetchBlocks(first_block + count, std::min(parallel_chunk_blocks, total_blocks - first_block - count + 1));
+		
+		buffered_file->readBlocksDirect(first_block, count, buffer);
+		if(write_back)
+			std::memcpy(originals[worker].data(), buffer, count * block_size);
+		
+		for(long b = 0; b < count; b++)
+		{
+			size_type first_index = (first_block + b - 1) * (size_type) perBlock();
+			size_type n = std::min((size_type) perBlock(), sz - first_index);
+			fn(task, (T*) (buffer + b * block_size), n);
+		}
+		
+		if(!write_back)
+			return;
+		
+		// each run of changed blocks goes out with one write
+		for(long b = 0; b < count; )
+		{
+			long run = 0;
+			while(b + run < count && std::memcmp(buffer + (b + run) * block_size, originals[worker].data() + (b + run) * block_size, block_size) != 0)
+				run++;
+			if(run > 0)
+				buffered_file->writeBlocksDirect(first_block + b, run, buffer + b * block_size);
+			b += run + 1;
+		}
+	});
+}
+
+template <typename T, size_t BlockSize>
+WorkStealingPool& vector<T, BlockSize>::workerPool(int threads) {
+	if(!pool || pool_threads != threads)
+	{
+		pool.reset();
+		pool.reset(new WorkStealingPool(threads));
+		pool_threads = threads;
+	}
+	return *pool;
+}
+
+template <typename T, size_t BlockSize>
+template <typename Function>
+void vector<T, BlockSize>::parallel_for_each(Function f, int threads) {
+	parallelBlocks([&](long, T* data, size_type n) {
+		for(size_type i = 0; i < n; i++)
+			f(data[i]);
+	}, true, threads);
+}
+
+template <typename T, size_t BlockSize>
+template <typename UnaryOp>
+void vector<T, BlockSize>::parallel_transform(UnaryOp op, int threads) {
+	parallelBlocks([&](long, T* data, size_type n) {
+		for(size_type i = 0; i < n; i++)
+			data[i] = op(data[i]);
+	}, true, threads);
+}
+
+template <typename T, size_t BlockSize>
+template <typename BinaryOp>
+T vector<T, BlockSize>::parallel_reduce(T init, BinaryOp op, int threads) {
+	long tasks = (num_blocks() + parallel_chunk_blocks - 1) / parallel_chunk_blocks;
+	std::vector<T> partial(tasks);
+	std::vector<char> seeded(tasks, 0);
+	
+	parallelBlocks([&](long task, T* data, size_type n) {
+		size_type i = 0;
+		if(!seeded[task] && n > 0)
+		{
+			partial[task] = data[i++];
+			seeded[task] = 1;
+		}
+		for(; i < n; i++)
+			partial[task] = op(partial[task], data[i]);
+	}, false, threads);
+	
+	for(long task = 0; task < tasks; task++)
+		init = op(init, partial[task]);
+	return init;
+}
+
+// one pass for the total of every chunk, then one that scans each chunk from its carry
+template <typename T, size_t BlockSize>
+template <typename BinaryOp>
+void vector<T, BlockSize>::parallel_inclusive_scan(BinaryOp op, int threads) {
+	long tasks = (num_blocks() + parallel_chunk_blocks - 1) / parallel_chunk_blocks;
+	if(tasks == 0)
+		return;
+	
+	std::vector<T> carry(tasks);
+	std::vector<char> seeded(tasks, 0);
+	
+	parallelBlocks([&](long task, T* data, size_type n) {
+		size_type i = 0;
+		if(!seeded[task] && n > 0)
+		{
+			carry[task] = data[i++];
+			seeded[task] = 1;
+		}
+		for(; i < n; i++)
+			carry[task] = op(carry[task], data[i]);
+	}, false, threads);
+	
+	// carry[task] becomes the total of everything before the chunk
+	for(long task = 1; task < tasks; task++)
+		carry[task] = op(carry[task - 1], carry[task]);
+	
+	std::vector<T> running(tasks);
+	std::vector<char> started(tasks, 0);
+	parallelBlocks([&](long task, T* data, size_type n) {
+		size_type i = 0;
+		if(!started[task] && n > 0)
+		{
+			running[task] = (task > 0) ? op(carry[task - 1], data[0]) : data[0];
+			data[i++] = running[task];
+			started[task] = 1;
+		}
+		for(; i < n; i++)
+		{
+			running[task] = op(running[task], data[i]);
+			data[i] = running[task];
+		}
+	}, true, threads);
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::erase(vector<T, BlockSize>::iterator start, vector<T, BlockSize>::iterator end)
 {
 	size_type first = start.index;
 	size_type last = end.index;
@@ -220,61 +1023,65 @@ void vector<T>::erase(vector<T>::iterator start, vector<T>::iterator end)
 	
 	while(num_element_shift > 0)
 	{
-		first_block_number = (first / num_elements_per_block) + 1;
-		first_block_offset = (first % num_elements_per_block);
-		copy_block_number = (copy_pos / num_elements_per_block) + 1;
-		copy_block_offset = (copy_pos % num_elements_per_block);
+		first_block_number = (first / perBlock()) + 1;
+		first_block_offset = (first % perBlock());
+		copy_block_number = (copy_pos / perBlock()) + 1;
+		copy_block_offset = (copy_pos % perBlock());
+		
+		// source blocks are consumed front to back
+		readAhead(copy_block_number);
 		
 		disk_block = buffered_file->readBlock(first_block_number);
 		copy_block = buffered_file->readBlock(copy_block_number);
 		
 		copy_data = BufferedFrameReader::readRawData(copy_block, copy_block_offset*element_size);
-		if((num_elements_per_block-copy_block_offset) <= num_element_shift)
+		if((perBlock()-copy_block_offset) <= num_element_shift)
 		{
-			if((num_elements_per_block-first_block_offset) <= (num_elements_per_block-copy_block_offset))
+			if((perBlock()-first_block_offset) <= (perBlock()-copy_block_offset))
 			{
 				BufferedFrameWriter::memmove(disk_block, copy_data, first_block_offset * element_size, 
-											 (num_elements_per_block - first_block_offset) * element_size);
+											 (perBlock() - first_block_offset) * element_size);
 				
-				first += (num_elements_per_block - first_block_offset);
-				copy_pos += (num_elements_per_block - first_block_offset);
+				first += (perBlock() - first_block_offset);
+				copy_pos += (perBlock() - first_block_offset);
 			}
 			else
 			{
 				BufferedFrameWriter::memmove(disk_block, copy_data, first_block_offset*element_size,
-											 (num_elements_per_block - copy_block_offset) * element_size);
-				first += (num_elements_per_block - copy_block_offset);
-				copy_pos += (num_elements_per_block - copy_block_offset);
+											 (perBlock() - copy_block_offset) * element_size);
+				first += (perBlock() - copy_block_offset);
+				copy_pos += (perBlock() - copy_block_offset);
 			}
 		}
 		else
 		{
-			if((num_elements_per_block-first_block_offset) <= num_element_shift)
+			if((perBlock()-first_block_offset) <= num_element_shift)
 			{
 				BufferedFrameWriter::memmove(disk_block, copy_data, first_block_offset * element_size, 
-											 (num_elements_per_block - first_block_offset) * element_size);
+											 (perBlock() - first_block_offset) * element_size);
 				
-				first += (num_elements_per_block - first_block_offset);
-				copy_pos += (num_elements_per_block - first_block_offset);
+				first += (perBlock() - first_block_offset);
+				copy_pos += (perBlock() - first_block_offset);
 			}
 			else
 			{
 				BufferedFrameWriter::memmove(disk_block, copy_data, first_block_offset*element_size,
 											 (num_element_shift) * element_size);				
 				first += (num_element_shift);
-				BufferedFrameWriter::memset(disk_block, 0, (first % num_elements_per_block) * element_size,
-											(num_elements_per_block - (first % num_elements_per_block)) * element_size);
+				BufferedFrameWriter::memset(disk_block, 0, (first % perBlock()) * element_size,
+											(perBlock() - (first % perBlock())) * element_size);
 				copy_pos += (num_element_shift);
 			}
 		}
 		num_element_shift = sz - copy_pos;
 	}
-	buffered_file->deleteBlock(first_block_number + 1);
+	// free every block past the new last element, also when nothing had to be shifted
+	buffered_file->deleteBlock(new_size > 0 ? ((new_size - 1) / perBlock()) + 2 : 1);
 	sz = new_size;
 }
 
-template <typename T>
-void vector<T>::insert(vector<T>::iterator pos, const T& elem)
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::insert(vector<T, BlockSize>::iterator pos, const T& elem)
 {
 	size_type position = pos.index;
 	
@@ -287,22 +1094,22 @@ void vector<T>::insert(vector<T>::iterator pos, const T& elem)
 		return;
 	}
 	
-	long insert_block_number = (position / num_elements_per_block) + 1;
-	long insert_block_offset = (position % num_elements_per_block) * element_size;
+	long insert_block_number = (position / perBlock()) + 1;
+	long insert_block_offset = (position % perBlock()) * element_size;
 	BufferFrame* disk_block = buffered_file->readBlock(insert_block_number);
 	
-	long last_block_number = (sz / num_elements_per_block) + 1;
-	long last_block_offset = (sz % num_elements_per_block) * element_size;
+	long last_block_number = (sz / perBlock()) + 1;
+	long last_block_offset = (sz % perBlock()) * element_size;
 	
 	if(last_block_offset == 0)
 		last_block_number -= 1;
 	
-	T overflow_element = BufferedFrameReader::read<T>(disk_block, (num_elements_per_block-1)*element_size);
+	T overflow_element = BufferedFrameReader::read<T>(disk_block, (perBlock()-1)*element_size);
 	
 	BufferedFrameWriter::memmove( disk_block, 
 											    BufferedFrameReader::readRawData(disk_block, insert_block_offset ), 
 											    insert_block_offset + element_size, 
-											    (num_elements_per_block - (position % num_elements_per_block))*element_size );
+											    (perBlock() - (position % perBlock()))*element_size );
 	
 	BufferedFrameWriter::write<T>(disk_block, insert_block_offset, elem);
 	
@@ -313,11 +1120,11 @@ void vector<T>::insert(vector<T>::iterator pos, const T& elem)
 	while(insert_block_number <= last_block_number)
 	{
 		disk_block = buffered_file->readBlock(insert_block_number);
-		overflow_element2 = BufferedFrameReader::read<T>(disk_block, (num_elements_per_block-1)*element_size);
+		overflow_element2 = BufferedFrameReader::read<T>(disk_block, (perBlock()-1)*element_size);
 		
 		BufferedFrameWriter::memmove( disk_block, 
 													BufferedFrameReader::readRawData(disk_block, 0), 
-													element_size, (num_elements_per_block-1)*element_size );
+													element_size, (perBlock()-1)*element_size );
 		
 		BufferedFrameWriter::write<T>(disk_block, 0, overflow_element);
 		
@@ -328,8 +1135,7 @@ void vector<T>::insert(vector<T>::iterator pos, const T& elem)
 	
 	if(last_block_offset == 0)
 	{
-		long new_block = buffered_file->allotBlock();
-		disk_block = buffered_file->readBlock(new_block);
+		disk_block = buffered_file->allotFrame();
 		
 		BufferedFrameWriter::write<T>(disk_block, 0, overflow_element);
 	}
@@ -337,9 +1143,9 @@ void vector<T>::insert(vector<T>::iterator pos, const T& elem)
 	sz ++;
 }
 
-template <typename T>
+template <typename T, size_t BlockSize>
 template <typename InputIterator>
-void vector<T>::insert(vector<T>::iterator pos, InputIterator first, InputIterator last)
+void vector<T, BlockSize>::insert(vector<T, BlockSize>::iterator pos, InputIterator first, InputIterator last)
 {
 	size_type position = pos.index;
 	if(position > sz)
@@ -348,9 +1154,9 @@ void vector<T>::insert(vector<T>::iterator pos, InputIterator first, InputIterat
 	auto num_element_insert = std::distance(first, last);
 	
 	size_type new_size = sz + num_element_insert;
-	long new_last_block = ((new_size/num_elements_per_block) + 1);
-	long new_last_offset = new_size%num_elements_per_block;
-	long last_block = (((sz-1)/num_elements_per_block) + 1);	
+	long new_last_block = ((new_size/perBlock()) + 1);
+	long new_last_offset = new_size%perBlock();
+	long last_block = (((sz-1)/perBlock()) + 1);	
 	
 	if(new_last_block != last_block)
 	{
@@ -363,44 +1169,44 @@ void vector<T>::insert(vector<T>::iterator pos, InputIterator first, InputIterat
 		
 		long copy_position, copy_block, copy_offset;
 		
-		while(new_last_block > (((position + num_element_insert)/num_elements_per_block)+1))
+		while(new_last_block > (((position + num_element_insert)/perBlock())+1))
 		{
 		
 			new_disk_block = buffered_file->readBlock(new_last_block);
 		
-			copy_position = ((new_last_block - 1)*num_elements_per_block) - num_element_insert;
-			copy_block = (copy_position/num_elements_per_block) + 1;
-			copy_offset = copy_position%num_elements_per_block;
+			copy_position = ((new_last_block - 1)*perBlock()) - num_element_insert;
+			copy_block = (copy_position/perBlock()) + 1;
+			copy_offset = copy_position%perBlock();
 		
-			if(((num_elements_per_block-copy_offset)+1) < new_last_offset)
+			if(((perBlock()-copy_offset)+1) < new_last_offset)
 			{
 				copy_disk_block = buffered_file->readBlock(copy_block+1);
 				copy_data = BufferedFrameReader::readRawData(copy_disk_block, 0);
 				
 				BufferedFrameWriter::memmove(new_disk_block, copy_data, 
-														((num_elements_per_block-copy_offset))*element_size,
-														(new_last_offset-((num_elements_per_block-copy_offset)))*element_size
+														((perBlock()-copy_offset))*element_size,
+														(new_last_offset-((perBlock()-copy_offset)))*element_size
 														);
 			}
 			
 			copy_disk_block = buffered_file->readBlock(copy_block);
 			copy_data = BufferedFrameReader::readRawData(copy_disk_block, copy_offset*element_size);
 			BufferedFrameWriter::memmove(new_disk_block, copy_data, 0,
-													(num_elements_per_block-copy_offset)*element_size);
+													(perBlock()-copy_offset)*element_size);
 			
 			new_last_block--;
-			new_last_offset = num_elements_per_block;
+			new_last_offset = perBlock();
 		}
 		
 		new_disk_block = buffered_file->readBlock(new_last_block);
-		long new_block_offset = (position + num_element_insert) % num_elements_per_block;
-		long num_left_insert = (num_elements_per_block - new_block_offset + 1);
+		long new_block_offset = (position + num_element_insert) % perBlock();
+		long num_left_insert = (perBlock() - new_block_offset + 1);
 		
-		copy_position = ((new_last_block-1)*num_elements_per_block) - num_element_insert + new_block_offset;
-		copy_block = (copy_position/num_elements_per_block) + 1;
-		copy_offset = copy_position%num_elements_per_block;
+		copy_position = ((new_last_block-1)*perBlock()) - num_element_insert + new_block_offset;
+		copy_block = (copy_position/perBlock()) + 1;
+		copy_offset = copy_position%perBlock();
 		
-		if((num_elements_per_block-copy_offset+1) >= num_left_insert)
+		if((perBlock()-copy_offset+1) >= num_left_insert)
 		{
 			copy_disk_block = buffered_file->readBlock(copy_block);
 			copy_data = BufferedFrameReader::readRawData(copy_disk_block, copy_offset*element_size);
@@ -413,8 +1219,8 @@ void vector<T>::insert(vector<T>::iterator pos, InputIterator first, InputIterat
 			copy_disk_block = buffered_file->readBlock(copy_block+1);
 			copy_data = BufferedFrameReader::readRawData(copy_disk_block, 0);
 			BufferedFrameWriter::memmove(new_disk_block, copy_data, 
-													   (new_block_offset + (num_elements_per_block-copy_offset+1))*element_size,
-													   (num_left_insert - (new_block_offset + (num_elements_per_block-copy_offset+1)))*element_size);
+													   (new_block_offset + (perBlock()-copy_offset+1))*element_size,
+													   (num_left_insert - (new_block_offset + (perBlock()-copy_offset+1)))*element_size);
 			
 			copy_disk_block = buffered_file->readBlock(copy_block);
 			copy_data = BufferedFrameReader::readRawData(copy_disk_block, copy_offset*element_size);
@@ -426,8 +1232,8 @@ void vector<T>::insert(vector<T>::iterator pos, InputIterator first, InputIterat
 		copy_position = position;
 		while(first!=last)
 		{
-			copy_block = (copy_position/num_elements_per_block) + 1;
-			copy_offset = (copy_position%num_elements_per_block) * element_size;
+			copy_block = (copy_position/perBlock()) + 1;
+			copy_offset = (copy_position%perBlock()) * element_size;
 			copy_disk_block = buffered_file->readBlock(copy_block);
 			BufferedFrameWriter::write<T>(copy_disk_block, copy_offset,(T)(*first));
 			copy_position ++;
@@ -440,14 +1246,14 @@ void vector<T>::insert(vector<T>::iterator pos, InputIterator first, InputIterat
 		const void* copy_data;
 		BufferFrame* disk_block = buffered_file->readBlock(last_block);
 		copy_data = BufferedFrameReader::readRawData(disk_block, 
-																   (position%num_elements_per_block)*element_size);
+																   (position%perBlock())*element_size);
 		BufferedFrameWriter::memmove(disk_block, copy_data, 
-												   ((position + num_element_insert)%num_elements_per_block)*element_size,
-												   ((sz%num_elements_per_block) - (position%num_elements_per_block))*element_size);
+												   ((position + num_element_insert)%perBlock())*element_size,
+												   ((sz%perBlock()) - (position%perBlock()))*element_size);
 		while(first!=last)
 		{
 				BufferedFrameWriter::write<T>(disk_block, 
-															(position%num_elements_per_block)*element_size, 
+															(position%perBlock())*element_size, 
 															(T)(*first));
 				position++;
 				first++;
@@ -456,104 +1262,640 @@ void vector<T>::insert(vector<T>::iterator pos, InputIterator first, InputIterat
 	sz += num_element_insert;
 }
 
-template <typename T>
-typename vector<T>::iterator vector<T>::begin() {
+template <typename T, size_t BlockSize>
+typename vector<T, BlockSize>::iterator vector<T, BlockSize>::begin() {
 	iterator iter(this);
 	return iter;
 }
 
-template <typename T>
-typename vector<T>::iterator vector<T>::end() {
+template <typename T, size_t BlockSize>
+typename vector<T, BlockSize>::iterator vector<T, BlockSize>::end() {
 	iterator iter(this);
 	iter.index = sz;
 	return iter;
 }
 
-template <typename T>
-typename vector<T>::const_iterator vector<T>::cbegin() {
+template <typename T, size_t BlockSize>
+typename vector<T, BlockSize>::const_iterator vector<T, BlockSize>::cbegin() {
 	const_iterator iter(this);
 	return iter;
 }
 
-template <typename T>
-typename vector<T>::const_iterator vector<T>::cend() {
+template <typename T, size_t BlockSize>
+typename vector<T, BlockSize>::const_iterator vector<T, BlockSize>::cend() {
 	const_iterator iter(this);
 	iter.index = sz;
 	return iter;
 }
 
-template <typename T>
-typename vector<T>::reverse_iterator vector<T>::rbegin() {
+template <typename T, size_t BlockSize>
+typename vector<T, BlockSize>::reverse_iterator vector<T, BlockSize>::rbegin() {
 	reverse_iterator iter(this);
 	return iter;
 }
 
-template <typename T>
-typename vector<T>::reverse_iterator vector<T>::rend() {
+template <typename T, size_t BlockSize>
+typename vector<T, BlockSize>::reverse_iterator vector<T, BlockSize>::rend() {
 	reverse_iterator iter(this);
 	iter.index = -1;
 	return iter;
 }
 
-template <typename T>
-T& vector<T>::iterator::operator* () {
-	return (*vec)[index];
+template <typename T, size_t BlockSize>
+BufferFrame* vector<T, BlockSize>::cursorBlock(block_cursor& cursor, vector<T, BlockSize>::size_type n) {
+	if(n >= sz || n < 0)
+		throw std::out_of_range{"vector<T>::iterator"};
+	
+	if(cursor.frame != nullptr && n >= cursor.first && n < cursor.last
+		&& cursor.frame->getBlockNumber() == cursor.block_number)
+		return cursor.frame;
+	
+	long block_number = (n / perBlock()) + 1;
+	BufferFrame* frame = buffered_file->readBlock(block_number);
+	
+	cursor.frame = frame;
+	cursor.block_number = block_number;
+	cursor.first = (block_number - 1) * perBlock();
+	cursor.last = cursor.first + perBlock();
+	
+	return frame;
+}
+
+template <typename T, size_t BlockSize>
+typename vector<T, BlockSize>::template block_span<const T> vector<T, BlockSize>::cblock(long b) {
+	if(b < 0 || b >= num_blocks())
+		throw std::out_of_range{"vector<T>::cblock()"};
+	
+	size_type first = b * (size_type) perBlock();
+	BufferFrame* frame = buffered_file->readBlock(b + 1);
+	return block_span<const T>(spanData(frame, (const T*) nullptr), std::min((size_type) perBlock(), sz - first));
+}
+
+// at most half the pool is used, so the blocks being worked on are not pushed out
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::readAhead(long block_number) {
+	long count = std::min(read_ahead_blocks, num_blocks() - block_number + 1);
+	
+	if(count <= 1 || buffered_file->isCached(block_number))
+		return;
+	
+	std::vector<BufferFrame*> frames = buffered_file->readBlockRange(block_number, count);
+	for(auto frame : frames)
+		frame->unpin();
+	
+	if(prefetch)
+		buffered_file->prefetchBlocks(block_number + count, std::min(read_ahead_blocks, num_blocks() - block_number - count + 1));
+}
+
+template <typename T, size_t BlockSize>
+template <typename U>
+typename vector<T, BlockSize>::template block_span<U> vector<T, BlockSize>::basic_block_iterator<U>::operator* () const {
+	size_type first = first_index();
+	
+	if(cursor.frame == nullptr || cursor.first != first)
+		vec->readAhead(block + 1);
+	
+	BufferFrame* frame = vec->cursorBlock(cursor, first);
+	return block_span<U>(spanData(frame, (U*) nullptr), std::min((size_type) vec->perBlock(), vec->sz - first));
+}
+
+template <typename T, size_t BlockSize>
+T& vector<T, BlockSize>::iterator::operator* () {
+	BufferFrame* frame = vec->cursorBlock(cursor, index);
+	return *(BufferedFrameReader::readPtr<T>(frame, (index - cursor.first) * vec->element_size));
 }
 
-template <typename T>
-bool vector<T>::iterator::operator>= (const vector<T>::iterator& rhs) {
+template <typename T, size_t BlockSize>
+bool vector<T, BlockSize>::iterator::operator>= (const vector<T, BlockSize>::iterator& rhs) {
 	if(index>=vec->sz && rhs.index>=vec->sz)
 		return true;
 
 	return index >= rhs.index;
 }
 
-template <typename T>
-bool vector<T>::iterator::operator<= (const vector<T>::iterator& rhs) {
+template <typename T, size_t BlockSize>
+bool vector<T, BlockSize>::iterator::operator<= (const vector<T, BlockSize>::iterator& rhs) {
 	if(index<0 && rhs.index<0)
 		return true;
 
 	return index <= rhs.index;
 }
 
-template <typename T>
-const T& vector<T>::const_iterator::operator* () const {
-	return (*vec)[index];
+template <typename T, size_t BlockSize>
+const T& vector<T, BlockSize>::const_iterator::operator* () const {
+	BufferFrame* frame = vec->cursorBlock(cursor, index);
+	return *((const T*) BufferedFrameReader::readRawData(frame, (index - cursor.first) * vec->element_size));
 }
 
-template <typename T>
-bool vector<T>::const_iterator::operator>= (const vector<T>::const_iterator& rhs) {
+template <typename T, size_t BlockSize>
+bool vector<T, BlockSize>::const_iterator::operator>= (const vector<T, BlockSize>::const_iterator& rhs) {
 	if(index>=vec->sz && rhs.index>=vec->sz)
 		return true;
 
 	return index >= rhs.index;
 }
 
-template <typename T>
-bool vector<T>::const_iterator::operator<= (const vector<T>::const_iterator& rhs) {
+template <typename T, size_t BlockSize>
+bool vector<T, BlockSize>::const_iterator::operator<= (const vector<T, BlockSize>::const_iterator& rhs) {
 	if(index<0 && rhs.index<0)
 		return true;
 
 	return index <= rhs.index;
 }
 
-template <typename T>
-T& vector<T>::reverse_iterator::operator* () {
-	return (*vec) [index];
+template <typename T, size_t BlockSize>
+T& vector<T, BlockSize>::reverse_iterator::operator* () {
+	BufferFrame* frame = vec->cursorBlock(cursor, index);
+	return *(BufferedFrameReader::readPtr<T>(frame, (index - cursor.first) * vec->element_size));
 }
 
-template <typename T>
-bool vector<T>::reverse_iterator::operator>= (const vector<T>::reverse_iterator& rhs) {
+template <typename T, size_t BlockSize>
+bool vector<T, BlockSize>::reverse_iterator::operator>= (const vector<T, BlockSize>::reverse_iterator& rhs) {
 	if(index<0 && rhs.index<0)
 		return true;
 
 	return index <= rhs.index;
 }
 
-template <typename T>
-bool vector<T>::reverse_iterator::operator<= (const vector<T>::reverse_iterator& rhs) {
+template <typename T, size_t BlockSize>
+bool vector<T, BlockSize>::reverse_iterator::operator<= (const vector<T, BlockSize>::reverse_iterator& rhs) {
 	if((index>=vec->sz && rhs.index>=vec->sz))
 		return true;
 
 	return index >= rhs.index;
 }
+
+template <typename T, size_t BlockSize>
+vector<T, BlockSize>::stream_writer::stream_writer(vector<T, BlockSize>& v, int num_buffers, long blocks) : vec(&v), buffer_blocks(blocks),
+	buffers(std::max(num_buffers, 1), nullptr), pending(std::max(num_buffers, 1)), current(0), index(0), total(v.sz), closed(false) {
+	if(buffer_blocks < 1)
+		buffer_blocks = 1;
+	
+	for(size_t i = 0; i < buffers.size(); i++)
+	{
+		void* buffer = nullptr;
+		if(posix_memalign(&buffer, 4096, buffer_blocks * vec->block_size) != 0)
+		{
+			for(size_t j = 0; j < i; j++)
+				free(buffers[j]);
+			throw std::bad_alloc();
+		}
+		std::memset(buffer, 0, buffer_blocks * vec->block_size);
+		buffers[i] = (char*) buffer;
+	}
+	
+	first_block = (total / vec->perBlock()) + 1;
+	index = total % vec->perBlock();
+	
+	// a partly filled last block is carried over, the pool must forget it as it gets rewritten directly
+	if(index != 0)
+	{
+		BufferFrame* frame = vec->buffered_file->readBlock(first_block);
+		std::memcpy(buffers[0], BufferedFrameReader::readRawData(frame, 0), vec->block_size);
+		vec->buffered_file->evictBlocks(first_block, 1);
+	}
+}
+
+template <typename T, size_t BlockSize>
+vector<T, BlockSize>::stream_writer::~stream_writer() {
+	try
+	{
+		close();
+	}
+	catch(...)
+	{
+	}
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::stream_writer::submit() {
+	long count = (index + vec->perBlock() - 1) / vec->perBlock();
+	while(vec->buffered_file->getLastBlock() < first_block + count - 1)
+		vec->buffered_file->allotBlock();
+	
+	BufferedFile* file = vec->buffered_file;
+	long block = first_block;
+	const char* data = buffers[current];
+	pending[current] = io.submit([file, block, count, data]() {
+		file->writeBlocksDirect(block, count, data);
+	});
+	
+	current = (current + 1) % buffers.size();
+	if(pending[current].valid())
+		pending[current].get();
+	std::memset(buffers[current], 0, buffer_blocks * vec->block_size);
+	
+	first_block += count;
+	index = 0;
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::stream_writer::push(const T& elem) {
+	if(closed)
+		throw std::runtime_error{"vector<T>::stream_writer closed"};
+	
+	if(index == buffer_blocks * (size_type) vec->perBlock())
+		submit();
+	
+	char* slot = buffers[current] + (index / vec->perBlock()) * vec->block_size + (index % vec->perBlock()) * vec->element_size;
+	*((T*) slot) = elem;
+	index++;
+	total++;
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::stream_writer::close() {
+	if(closed)
+		return;
+	closed = true;
+	
+	std::exception_ptr error;
+	try
+	{
+		if(index > 0)
+			submit();
+	}
+	catch(...)
+	{
+		error = std::current_exception();
+	}
+	
+	for(size_t i = 0; i < pending.size(); i++)
+	{
+		try
+		{
+			if(pending[i].valid())
+				pending[i].get();
+		}
+		catch(...)
+		{
+			if(!error)
+				error = std::current_exception();
+		}
+	}
+	for(size_t i = 0; i < buffers.size(); i++)
+		free(buffers[i]);
+	
+	if(error)
+		std::rethrow_exception(error);
+	
+	vec->sz = total;
+	BufferedFrameWriter::write<size_type>(vec->buffered_file->readHeader(), sizeof(long), vec->sz);
+	vec->buffered_file->writeHeader();
+}
+
+template <typename T, size_t BlockSize>
+vector<T, BlockSize>::stream_reader::stream_reader(vector<T, BlockSize>& v, size_type first, int num_buffers, long blocks) : vec(&v), buffer_blocks(blocks),
+	buffers(std::max(num_buffers, 1), nullptr), pending(std::max(num_buffers, 1)), current(0), index(first), end_index(v.sz), slot(0) {
+	if(buffer_blocks < 1)
+		buffer_blocks = 1;
+	if(index < 0)
+		index = 0;
+	
+	for(size_t i = 0; i < buffers.size(); i++)
+	{
+		void* buffer = nullptr;
+		if(posix_memalign(&buffer, 4096, buffer_blocks * vec->block_size) != 0)
+		{
+			for(size_t j = 0; j < i; j++)
+				free(buffers[j]);
+			throw std::bad_alloc();
+		}
+		buffers[i] = (char*) buffer;
+	}
+	
+	// the reads go straight to the file, it must hold everything the pool has
+	vec->buffered_file->flush();
+	
+	next_block = (index / vec->perBlock()) + 1;
+	slot = index % vec->perBlock();
+	for(size_t i = 0; i < buffers.size(); i++)
+		fetch(i);
+	if(pending[0].valid())
+		pending[0].get();
+}
+
+template <typename T, size_t BlockSize>
+vector<T, BlockSize>::stream_reader::~stream_reader() {
+	for(size_t i = 0; i < pending.size(); i++)
+	{
+		if(pending[i].valid())
+			pending[i].wait();
+	}
+	for(size_t i = 0; i < buffers.size(); i++)
+		free(buffers[i]);
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::stream_reader::fetch(int buffer) {
+	long last_block = vec->num_blocks();
+	if(next_block > last_block)
+		return;
+	
+	long count = std::min(buffer_blocks, last_block - next_block + 1);
+	BufferedFile* file = vec->buffered_file;
+	long block = next_block;
+	char* data = buffers[buffer];
+	pending[buffer] = io.submit([file, block, count, data]() {
+		file->readBlocksDirect(block, count, data);
+	});
+	next_block += count;
+}
+
+template <typename T, size_t BlockSize>
+typename vector<T, BlockSize>::stream_reader& vector<T, BlockSize>::stream_reader::operator++ () {
+	index++;
+	slot++;
+	
+	// the used buffer is refilled from further on and the next one, read meanwhile, takes over
+	if(slot == buffer_blocks * (size_type) vec->perBlock() && index < end_index)
+	{
+		fetch(current);
+		current = (current + 1) % buffers.size();
+		if(pending[current].valid())
+			pending[current].get();
+		slot = 0;
+	}
+	return *this;
+}
+
+template <typename T, size_t BlockSize>
+vector<T, BlockSize>::concurrent_appender::concurrent_appender(vector<T, BlockSize>& v, long blocks) : vec(&v), buffer_blocks(std::max(blocks, 1L)),
+	first_block(v.sz / v.perBlock() + 1), reserved(v.sz), committed(v.sz), holding(0), closed(false) {
+	// producers write around the pool, it must hold nothing newer than the file
+	vec->buffered_file->flush();
+}
+
+template <typename T, size_t BlockSize>
+vector<T, BlockSize>::concurrent_appender::~concurrent_appender() {
+	try
+	{
+		close();
+	}
+	catch(...)
+	{
+	}
+}
+
+template <typename T, size_t BlockSize>
+vector<T, BlockSize>::concurrent_appender::producer::~producer() {
+	// elements that cannot be flushed any more are dropped, and the appender still counts them
+	// as held so close() reports it
+	try
+	{
+		flush();
+	}
+	catch(...)
+	{
+	}
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::concurrent_appender::producer::push(const T& elem) {
+	if(elems.empty())
+		owner->holding++;
+	elems.push_back(elem);
+	if(elems.size() == buffer_elems)
+		flush();
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::concurrent_appender::producer::append(const T* first, size_type n) {
+	while(n > 0)
+	{
+		if(elems.empty())
+			owner->holding++;
+		size_type take = std::min(n, (size_type) (buffer_elems - elems.size()));
+		elems.insert(elems.end(), first, first + take);
+		first += take;
+		n -= take;
+		if(elems.size() == buffer_elems)
+			flush();
+	}
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::concurrent_appender::producer::flush() {
+	if(elems.empty())
+		return;
+	if(owner->closed)
+		throw std::runtime_error{"vector<T>::concurrent_appender closed"};
+	
+	const vector<T, BlockSize>* vec = owner->vec;
+	size_type n = elems.size();
+	size_type first = owner->reserved.fetch_add(n);
+	
+	// blocks shared with the neighbouring ranges are only written where these elements go
+	size_t per_block = vec->perBlock();
+	size_t first_slot = first % per_block;
+	size_t blocks = (first_slot + n + per_block - 1) / per_block;
+	staging.assign(blocks * vec->block_size, 0);
+	for(size_type i = 0; i < n; i++)
+	{
+		size_t slot = first_slot + i;
+		std::memcpy(staging.data() + (slot / per_block) * vec->block_size + (slot % per_block) * element_size, &elems[i], element_size);
+	}
+	
+	size_t from = first_slot * element_size;
+	size_t to = (blocks - 1) * vec->block_size + ((first_slot + n - 1) % per_block + 1) * element_size;
+	off_t block_offset = (off_t) (first / per_block + 1) * vec->block_size;
+	vec->buffered_file->writeBytesDirect(block_offset + from, to - from, staging.data() + from);
+	
+	elems.clear();
+	owner->commit(first, first + n);
+	owner->holding--;
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::concurrent_appender::commit(size_type first, size_type last) {
+	std::lock_guard<std::mutex> lock(finished_lock);
+	finished[first] = last;
+	
+	// the watermark moves over every range that now follows on from it
+	size_type mark = committed.load(std::memory_order_relaxed);
+	auto next = finished.begin();
+	while(next != finished.end() && next->first == mark)
+	{
+		mark = next->second;
+		next = finished.erase(next);
+	}
+	committed.store(mark, std::memory_order_release);
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::concurrent_appender::read(size_type first, size_type n, T* out) const {
+	if(first < 0 || n < 0 || first + n > size())
+		throw std::out_of_range{"vector<T>::concurrent_appender::read()"};
+	
+	size_t per_block = vec->perBlock();
+	while(n > 0)
+	{
+		size_t slot = first % per_block;
+		size_type take = std::min(n, (size_type) (per_block - slot));
+		off_t offset = (off_t) (first / per_block + 1) * vec->block_size + slot * element_size;
+		vec->buffered_file->readBytesDirect(offset, take * element_size, out);
+		out += take;
+		first += take;
+		n -= take;
+	}
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::concurrent_appender::close() {
+	if(closed)
+		return;
+	
+	if(holding.load() != 0)
+		throw std::runtime_error{"vector<T>::concurrent_appender closed before every producer flushed"};
+	size_type total = reserved.load();
+	if(committed.load() != total)
+		throw std::runtime_error{"vector<T>::concurrent_appender closed before every producer flushed"};
+	closed = true;
+	
+	// the file grew under the pool, it learns of the new blocks and forgets stale copies of the old last one
+	long last_block = (total + vec->perBlock() - 1) / vec->perBlock();
+	while(vec->buffered_file->getLastBlock() < last_block)
+		vec->buffered_file->allotBlock();
+	if(last_block >= first_block)
+		vec->buffered_file->evictBlocks(first_block, last_block - first_block + 1);
+	
+	vec->sz = total;
+	BufferedFrameWriter::write<size_type>(vec->buffered_file->readHeader(), sizeof(long), vec->sz);
+	vec->buffered_file->writeHeader();
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::batch_edit::insert(size_type pos, const T& elem) {
+	if(pos < 0 || pos > vec->sz)
+		throw std::out_of_range{"vector<T>::batch_edit::insert()"};
+	
+	insertion edit = { pos, elem };
+	inserts.push_back(edit);
+}
+
+template <typename T, size_t BlockSize>
+template <typename InputIterator>
+void vector<T, BlockSize>::batch_edit::insert(size_type pos, InputIterator first, InputIterator last) {
+	for(; first != last; ++first)
+		insert(pos, *first);
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::batch_edit::erase(size_type first, size_type last) {
+	if(first > last)
+		return;
+	if(first < 0 || last >= vec->sz)
+		throw std::out_of_range{"vector<T>::batch_edit::erase()"};
+	
+	erases.push_back(std::make_pair(first, last));
+}
+
+template <typename T, size_t BlockSize>
+vector<T, BlockSize>::batch_edit::~batch_edit() {
+	try
+	{
+		apply();
+	}
+	catch(...)
+	{
+	}
+}
+
+template <typename T, size_t BlockSize>
+void vector<T, BlockSize>::batch_edit::apply() {
+	if(inserts.empty() && erases.empty())
+		return;
+	
+	// taken out first, a failure partway leaves the vector half edited and they must not be applied again
+	std::vector<insertion> batch_inserts;
+	std::vector< std::pair<size_type, size_type> > batch_erases;
+	batch_inserts.swap(inserts);
+	batch_erases.swap(erases);
+	
+	std::stable_sort(batch_inserts.begin(), batch_inserts.end(), [](const insertion& a, const insertion& b) { return a.pos < b.pos; });
+	std::sort(batch_erases.begin(), batch_erases.end());
+	
+	const size_type n = vec->sz;
+	const size_type per_block = vec->perBlock();
+	const size_t element_size = vec->element_size;
+	BufferedFile* file = vec->buffered_file;
+	
+	size_type start = n;
+	if(!batch_inserts.empty())
+		start = batch_inserts.front().pos;
+	if(!batch_erases.empty())
+		start = std::min(start, batch_erases.front().first);
+	
+	// the original elements read in so far and not yet passed on, from index consumed on
+	std::deque<T> waiting;
+	size_type read_to = start - start % per_block;
+	size_type consumed = read_to;
+	auto readNext = [&]() {
+		long block_number = read_to / per_block + 1;
+		vec->readAhead(block_number);
+		BufferFrame* frame = file->readBlock(block_number);
+		size_type count = std::min(per_block, n - read_to);
+		for(size_type k = 0; k < count; k++)
+			waiting.push_back(BufferedFrameReader::read<T>(frame, k * element_size));
+		read_to += count;
+	};
+	
+	// output goes a block at a time, a block is only written once all of its old elements are read
+	std::vector<char> out(vec->block_size, 0);
+	size_type written = start - start % per_block;
+	size_type out_count = 0;
+	auto flushOut = [&]() {
+		long block_number = written / per_block + 1;
+		while(read_to < n && read_to < written + per_block)
+			readNext();
+		BufferFrame* frame = block_number > file->getLastBlock() ? file->allotFrame() : file->readBlock(block_number);
+		BufferedFrameWriter::memcpy(frame, out.data(), 0, vec->block_size);
+		std::fill(out.begin(), out.end(), 0);
+		written += per_block;
+		out_count = 0;
+	};
+	auto put = [&](const T& elem) {
+		std::memcpy(out.data() + out_count * element_size, &elem, element_size);
+		if(++out_count == per_block)
+			flushOut();
+	};
+	auto take = [&]() {
+		if(waiting.empty())
+			readNext();
+		T elem = waiting.front();
+		waiting.pop_front();
+		consumed++;
+		return elem;
+	};
+	
+	// the untouched elements in front of start in its block
+	while(consumed < start)
+		put(take());
+	
+	size_t next_insert = 0, next_erase = 0;
+	for(size_type i = start; i < n; i++)
+	{
+		for(; next_insert < batch_inserts.size() && batch_inserts[next_insert].pos == i; next_insert++)
+			put(batch_inserts[next_insert].value);
+		
+		while(next_erase < batch_erases.size() && batch_erases[next_erase].second < i)
+			next_erase++;
+		bool erased = next_erase < batch_erases.size() && batch_erases[next_erase].first <= i;
+		
+		T elem = take();
+		if(!erased)
+			put(elem);
+	}
+	for(; next_insert < batch_inserts.size(); next_insert++)
+		put(batch_inserts[next_insert].value);
+	
+	size_type new_size = written + out_count;
+	if(out_count > 0)
+		flushOut();
+	
+	// free every block past the new last element
+	file->deleteBlock(new_size > 0 ? ((new_size - 1) / per_block) + 2 : 1);
+	vec->sz = new_size;
+}
+
+#endif
@@ -15,9 +15,10 @@ private:
 	size_type sz;
 
 public:        
-	vector(const char* pathname, size_type blocksize) : block_size(blocksize), element_size(sizeof(T)),
+	// pool_blocks is the size of the buffer pool in blocks
+	vector(const char* pathname, size_type blocksize, size_t pool_blocks = 3) : block_size(blocksize), element_size(sizeof(T)),
 		sz(0), num_elements_per_block(blocksize/(sizeof(T))) {
-		buffered_file = new BufferedFile(pathname, block_size, block_size*3);
+		buffered_file = new BufferedFile(pathname, block_size, block_size*pool_blocks);
 		
 		// dirty way to decode the header. reading size from header.
 		BufferFrame* header = buffered_file->readHeader();
@@ -86,9 +87,6 @@ void vector<T>::pop_back() {
 
 template <typename T>
 void vector<T>::clear() {
-	for(auto i = (sz/num_elements_per_block) + 1; i > 0; i--)
-	{
-		buffered_file->deleteBlock(i);
-	}
+	buffered_file->deleteBlock(1);
 	sz = 0;
 }
\ No newline at end of file
@@ -0,0 +1,207 @@
+#ifndef VECTOR_VIEW_H
+#define VECTOR_VIEW_H
+
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* read-only view of a vector<T> file, straight from an mmap of the file
+ *
+ * there is no buffer pool: elements are read in place from the page
+ * cache, so every process viewing the file shares one copy of it. the
+ * file is locked shared, like BufferedFile::READ_ONLY, so it can not
+ * change under the view. the layout is the one vector<T> writes: block
+ * 0 is the header with the size at offset sizeof(long), element n sits
+ * in block n / elements_per_block() + 1.
+ */
+
+template <typename T>
+class vector_view
+{
+public:
+	typedef long long int size_type;
+
+	// the elements of one block, contiguous in memory
+	class block_span {
+	private:
+		const T* ptr;
+		size_type count;
+	public:
+		block_span(const T* p, size_type n) : ptr(p), count(n) {}
+		const T* data() const { return ptr; }
+		size_type size() const { return count; }
+		const T* begin() const { return ptr; }
+		const T* end() const { return ptr + count; }
+		const T& operator[] (size_type n) const { return ptr[n]; }
+	};
+
+	class const_iterator : public std::iterator<std::random_access_iterator_tag, T, std::ptrdiff_t, const T*, const T&> {
+	private:
+		const vector_view* view;
+		size_type index;
+	public:
+		const_iterator() : view(nullptr), index(0) {}
+		const_iterator(const vector_view* v, size_type i) : view(v), index(i) {}
+		const T& operator* () const { return view->element(index); }
+		const T* operator-> () const { return &view->element(index); }
+		const T& operator[] (std::ptrdiff_t n) const { return view->element(index + n); }
+		const_iterator& operator++ () { index++; return *this; }
+		const_iterator operator++(int) { const_iterator tmp(*this); index++; return tmp; }
+		const_iterator& operator-- () { index--; return *this; }
+		const_iterator operator--(int) { const_iterator tmp(*this); index--; return tmp; }
+		const_iterator& operator+= (std::ptrdiff_t n) { index += n; return *this; }
+		const_iterator& operator-= (std::ptrdiff_t n) { index -= n; return *this; }
+		const_iterator operator+ (std::ptrdiff_t n) const { return const_iterator(view, index + n); }
+		const_iterator operator- (std::ptrdiff_t n) const { return const_iterator(view, index - n); }
+		friend const_iterator operator+ (std::ptrdiff_t n, const const_iterator& it) { return it + n; }
+		std::ptrdiff_t operator- (const const_iterator& rhs) const { return index - rhs.index; }
+		bool operator== (const const_iterator& rhs) const { return index == rhs.index; }
+		bool operator!= (const const_iterator& rhs) const { return index != rhs.index; }
+		bool operator< (const const_iterator& rhs) const { return index < rhs.index; }
+		bool operator> (const const_iterator& rhs) const { return index > rhs.index; }
+		bool operator<= (const const_iterator& rhs) const { return index <= rhs.index; }
+		bool operator>= (const const_iterator& rhs) const { return index >= rhs.index; }
+	};
+
+	class block_iterator : public std::iterator<std::forward_iterator_tag, block_span> {
+	private:
+		const vector_view* view;
+		long block;
+	public:
+		block_iterator(const vector_view* v, long b) : view(v), block(b) {}
+		block_span operator* () const { return view->block(block); }
+		block_iterator& operator++ () { block++; return *this; }
+		block_iterator operator++(int) { block_iterator tmp(*this); block++; return tmp; }
+		bool operator== (const block_iterator& rhs) const { return block == rhs.block; }
+		bool operator!= (const block_iterator& rhs) const { return block != rhs.block; }
+	};
+
+	class block_range {
+	private:
+		block_iterator first, last;
+	public:
+		block_range(block_iterator f, block_iterator l) : first(f), last(l) {}
+		block_iterator begin() const { return first; }
+		block_iterator end() const { return last; }
+	};
+
+private:
+	const size_t block_size;
+	const size_t num_elements_per_block;
+	int fd;
+	const char* mapping;
+	size_t mapping_size;
+	size_type sz;
+
+	const T& element(size_type n) const
+	{
+		return *(const T*) (mapping + (n / num_elements_per_block + 1) * block_size + (n % num_elements_per_block) * sizeof(T));
+	}
+
+public:
+	vector_view(const char* pathname, size_t blocksize) : block_size(blocksize), num_elements_per_block(blocksize/(sizeof(T))),
+		fd(-1), mapping(nullptr), mapping_size(0), sz(0) {
+		if(num_elements_per_block == 0 || block_size < sizeof(long) + sizeof(size_type))
+			throw std::invalid_argument{"vector_view<T>: block size does not fit"};
+
+		fd = open(pathname, O_RDONLY);
+		if(fd == -1)
+			throw std::runtime_error{"Unable to open file"};
+
+		// shares the file with other readers, never with a writer
+		if(flock(fd, LOCK_SH | LOCK_NB) == -1)
+		{
+			close(fd);
+			throw std::runtime_error{"Unable to lock file"};
+		}
+
+		struct stat file_stat;
+		if(fstat(fd, &file_stat) != 0 || (size_t) file_stat.st_size < block_size)
+		{
+			close(fd);
+			throw std::runtime_error{"Not a vector file"};
+		}
+
+		void* addr = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if(addr == MAP_FAILED)
+		{
+			close(fd);
+			throw std::runtime_error{"Unable to map file"};
+		}
+		mapping = (const char*) addr;
+		mapping_size = file_stat.st_size;
+
+		sz = *(const size_type*) (mapping + sizeof(long));
+		if(sz < 0 || (size_t) (num_blocks() + 1) * block_size > mapping_size)
+		{
+			munmap((void*) mapping, mapping_size);
+			close(fd);
+			throw std::runtime_error{"Not a vector file"};
+		}
+	}
+
+	~vector_view()
+	{
+		munmap((void*) mapping, mapping_size);
+		flock(fd, LOCK_UN | LOCK_NB);
+		close(fd);
+	}
+
+	vector_view(const vector_view&) = delete;
+	vector_view& operator= (const vector_view&) = delete;
+
+	size_type size() const { return sz; }
+	bool empty() const { return sz == 0; }
+	size_type elements_per_block() const { return num_elements_per_block; }
+	long num_blocks() const { return (sz + num_elements_per_block - 1) / num_elements_per_block; }
+
+	const T& operator[] (size_type n) const { return element(n); }
+	const T& at(size_type n) const
+	{
+		if(n >= sz || n < 0)
+			throw std::out_of_range{"vector_view<T>::at()"};
+		return element(n);
+	}
+
+	// block b, counted from 0, as a span of up to elements_per_block() elements
+	block_span block(long b) const
+	{
+		size_type first = b * (size_type) num_elements_per_block;
+		size_type count = (sz - first < (size_type) num_elements_per_block) ? sz - first : num_elements_per_block;
+		return block_span((const T*) (mapping + (b + 1) * block_size), count);
+	}
+	block_range blocks() const { return block_range(block_iterator(this, 0), block_iterator(this, num_blocks())); }
+
+	// when blocks hold no padding the elements follow each other across blocks
+	bool contiguous() const { return num_elements_per_block * sizeof(T) == block_size; }
+	// every element in one array, only when contiguous(), nullptr otherwise
+	const T* data() const { return contiguous() ? (const T*) (mapping + block_size) : nullptr; }
+
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, sz); }
+	const_iterator cbegin() const { return begin(); }
+	const_iterator cend() const { return end(); }
+
+	// MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED, ... for the whole file or for the blocks of elements [first, first + count)
+	void advise(int advice) const { madvise((void*) mapping, mapping_size, advice); }
+	void advise(int advice, size_type first, size_type count) const
+	{
+		if(count <= 0)
+			return;
+
+		size_t page_size = sysconf(_SC_PAGESIZE);
+		size_t start = (first / num_elements_per_block + 1) * block_size;
+		size_t stop = ((first + count - 1) / num_elements_per_block + 2) * block_size;
+		start -= start % page_size;
+		if(stop > mapping_size)
+			stop = mapping_size;
+		madvise((void*) (mapping + start), stop - start, advice);
+	}
+};
+
+#endif
@@ -0,0 +1,83 @@
+#include "buffer.h"
+#include <random>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#if !defined(__cpp_impl_coroutine)
+#error "block_async_test needs coroutines, build it with -std=c++20"
+#endif
+
+#define NUM_BLOCKS 2000
+#define NUM_TASKS 200
+#define LOOKUPS_PER_TASK 50
+
+// every block holds its own number at offset 0
+BlockTask lookups(BufferedFile& file, std::vector<long> blocks, long& sum, long& wrong)
+{
+	for(size_t i = 0; i < blocks.size(); i++)
+	{
+		BufferFrame* frame = co_await file.readBlockAsync(blocks[i]);
+		long stored = BufferedFrameReader::read<long>(frame, 0);
+		sum += stored;
+		if(stored != blocks[i])
+			wrong++;
+	}
+}
+
+BlockTask failing(BufferedFile& file)
+{
+	co_await file.readBlockAsync(1);
+	throw std::runtime_error{"task failed"};
+}
+
+int main()
+{
+	std::default_random_engine generator;
+	std::uniform_int_distribution<long> distribution(1,NUM_BLOCKS);
+
+	auto dice = std::bind ( distribution, generator );
+
+	unlink("./asyncfile");
+	{
+		BufferedFile file("./asyncfile", 4096, 4096*16);
+		for(long i = 1; i <= NUM_BLOCKS; i++)
+		{
+			BufferFrame* frame = file.allotFrame();
+			BufferedFrameWriter::write<long>(frame, 0, frame->getBlockNumber());
+		}
+	}
+
+	BufferedFile file("./asyncfile", 4096, 4096*16, BufferedFile::READ_ONLY);
+	std::cout << file.getLastBlock() << std::endl;
+
+	long sum = 0, wrong = 0, expected = 0;
+	BlockScheduler sched(&file);
+	for(auto t = 0; t < NUM_TASKS; t++)
+	{
+		std::vector<long> blocks;
+		for(auto i = 0; i < LOOKUPS_PER_TASK; i++)
+		{
+			blocks.push_back(dice());
+			expected += blocks.back();
+		}
+		sched.spawn(lookups(file, blocks, sum, wrong));
+	}
+	sched.run();
+	std::cout << (sum == expected) << " " << wrong << std::endl;
+
+	// a task exception comes out of run()
+	BlockScheduler failing_sched(&file);
+	failing_sched.spawn(failing(file));
+	try
+	{
+		failing_sched.run();
+		std::cout << "no exception" << std::endl;
+	}
+	catch(const std::runtime_error& e)
+	{
+		std::cout << e.what() << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,106 @@
+#include "column_vector.h"
+#include <random>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#define NUM_INSERT 100000
+
+int main()
+{
+	std::default_random_engine generator;
+	std::uniform_int_distribution<int> distribution(1,1000);
+
+	auto dice = std::bind ( distribution, generator );
+
+	std::vector<long> ids;
+	std::vector<int> quantities;
+	std::vector<double> prices;
+	for(auto i = 1; i<=NUM_INSERT; i++)
+	{
+		ids.push_back(i);
+		quantities.push_back(dice());
+		prices.push_back(dice() / 4.0);
+	}
+
+	for(auto i = 0; i < 3; i++)
+		unlink(("./colvec." + std::to_string(i)).c_str());
+
+	long long qty_sum = 0;
+	double value = 0;
+	for(auto i = 0; i < NUM_INSERT; i++)
+	{
+		qty_sum += quantities[i];
+		value += quantities[i] * prices[i];
+	}
+
+	{
+		column_vector<long, int, double> trades("./colvec", 4096);
+		for(auto i = 0; i < NUM_INSERT / 2; i++)
+			trades.push_back(ids[i], quantities[i], prices[i]);
+		trades.append(NUM_INSERT / 2, ids.data() + NUM_INSERT / 2, quantities.data() + NUM_INSERT / 2, prices.data() + NUM_INSERT / 2);
+		std::cout << trades.size() << " " << trades.column<0>().size() << " " << trades.column<1>().size() << " " << trades.column<2>().size() << std::endl;
+
+		auto row = trades.row(777);
+		std::cout << (std::get<0>(row) == ids[777]) << " " << (std::get<1>(row) == quantities[777]) << " " << (std::get<2>(row) == prices[777]) << std::endl;
+
+		double scanned = 0;
+		trades.scan<1, 2>([&](int qty, double price) { scanned += qty * price; });
+		std::cout << (trades.column<1>().sum() == qty_sum) << " " << (scanned == value) << std::endl;
+
+		trades.push_back(std::make_tuple(0L, 5, 1.5));
+		trades.pop_back();
+		trades.resize(NUM_INSERT - 10);
+		std::cout << trades.size() << " " << trades.column<2>().size() << std::endl;
+	}
+
+	// the columns are opened again at the length they were left at
+	{
+		column_vector<long, int, double> trades("./colvec", 4096);
+		auto row = trades.row(NUM_INSERT - 11);
+		std::cout << trades.size() << " " << (std::get<0>(row) == ids[NUM_INSERT - 11]) << std::endl;
+		trades.clear();
+		std::cout << trades.size() << " " << trades.column<1>().size() << std::endl;
+	}
+
+	// a column that is longer than the others is refused
+	{
+		vector<long> ids_column("./colvec.0", (size_t) 4096);
+		ids_column.push_back(1);
+	}
+	try
+	{
+		column_vector<long, int, double> trades("./colvec", 4096);
+		std::cout << "opened" << std::endl;
+	}
+	catch(const std::runtime_error& e)
+	{
+		std::cout << e.what() << std::endl;
+	}
+
+	// a read-only table refuses the push in its first column, and the columns stay even
+	for(auto i = 0; i < 2; i++)
+		unlink(("./colvec_ro." + std::to_string(i)).c_str());
+	{
+		column_vector<int, long> pairs("./colvec_ro", 4096);
+		for(auto i = 0; i < 512; i++)
+			pairs.push_back(i, i);
+	}
+	{
+		vector_options options;
+		options.mode = BufferedFile::READ_ONLY;
+		column_vector<int, long> pairs("./colvec_ro", 4096, options);
+		try
+		{
+			pairs.push_back(512, 512);
+			std::cout << "pushed" << std::endl;
+		}
+		catch(const std::runtime_error& e)
+		{
+			std::cout << e.what() << std::endl;
+		}
+		std::cout << pairs.column<0>().size() << " " << pairs.column<1>().size() << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,79 @@
+#include "indexed_vector.h"
+#include <random>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#define NUM_INSERT 8050
+
+int main()
+{
+	indexed_vector<int> exvec("./indexvec", (size_t) 4096);
+	exvec.clear();
+
+	std::default_random_engine generator;
+	std::uniform_int_distribution<int> distribution(1,1000);
+
+	auto dice = std::bind ( distribution, generator );
+
+	for(auto i = 1; i<=NUM_INSERT; i++)
+		exvec.push_back(dice());
+
+	std::cout << exvec.size() << " " << exvec.num_blocks() << std::endl;
+
+	// inserts in the middle split a block instead of shifting the file
+	for(auto i = 1; i<=500; i++)
+		exvec.insert(16, i);
+
+	std::vector<int> ins_vec;
+	for(auto i = 1; i<=231; i++)
+		ins_vec.push_back(dice());
+	exvec.insert(4000, ins_vec.begin(), ins_vec.end());
+
+	std::cout << exvec.size() << " " << exvec.num_blocks() << std::endl;
+	std::cout << exvec[16] << " " << exvec[515] << " " << exvec[4000] << std::endl;
+
+	exvec.erase(2, 6000);
+
+	std::cout << exvec.size() << " " << exvec.num_blocks() << " " << exvec.fill_factor() << std::endl;
+
+	exvec.compact();
+
+	std::cout << exvec.size() << " " << exvec.num_blocks() << " " << exvec.fill_factor() << std::endl;
+
+	for (auto it = 0; it < exvec.size(); it += 250)
+	{
+		std::cout << exvec[it] << std::endl;
+	}
+
+	// a block map that cannot be written is reported by close(), the destructor swallows it
+	unlink("./indexvec_close");
+	unlink("./indexvec_close.map");
+	rmdir("./indexvec_close.map");
+	{
+		indexed_vector<int> closing("./indexvec_close", (size_t) 4096);
+		closing.push_back(1);
+		mkdir("./indexvec_close.map", 0755);
+		try
+		{
+			closing.close();
+			std::cout << "closed" << std::endl;
+		}
+		catch(const std::runtime_error& e)
+		{
+			std::cout << e.what() << std::endl;
+		}
+	}
+	rmdir("./indexvec_close.map");
+	{
+		indexed_vector<int> closing("./indexvec_close", (size_t) 4096);
+		closing.push_back(2);
+		closing.close();
+	}
+	{
+		indexed_vector<int> reopened("./indexvec_close", (size_t) 4096, BufferedFile::READ_ONLY);
+		std::cout << reopened.size() << std::endl;
+	}
+
+	return 0;
+}
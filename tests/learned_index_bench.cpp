@@ -0,0 +1,69 @@
+#include "learned_index.h"
+#include "btree.h"
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <vector>
+
+#define NUM_KEYS 200000
+#define NUM_LOOKUPS 200000
+
+struct bench_Comparator {
+	bench_Comparator() {}
+	int operator()(long x, long y) const { return x > y; }
+};
+
+int main()
+{
+	std::default_random_engine generator;
+	std::uniform_int_distribution<long> gap(1, 1000);
+	std::vector<long> keys(NUM_KEYS);
+	long key = 1500000000000;
+	for (size_t i = 0; i < keys.size(); i++)
+		keys[i] = (key += gap(generator));
+
+	vector<long> sorted("./learnedvec", (size_t) 4096);
+	sorted.assign(keys.data(), keys.size());
+
+	// the tree is built from scratch every run
+	unlink("./learnedtree");
+	unlink("data_file");
+	BTree<long, long, bench_Comparator>* btree = new BTree<long, long, bench_Comparator>("./learnedtree");
+	for (size_t i = 0; i < keys.size(); i++)
+		btree->insertElem(keys[i], i);
+
+	auto start = std::chrono::steady_clock::now();
+	learned_index<long> index(sorted, 64);
+	double build = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::uniform_int_distribution<long> pick(0, NUM_KEYS - 1);
+	std::vector<long> lookups(NUM_LOOKUPS);
+	for (size_t i = 0; i < lookups.size(); i++)
+		lookups[i] = keys[pick(generator)];
+
+	long long learned_sum = 0, btree_sum = 0;
+	long learned_reads = sorted.blocks_read();
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < lookups.size(); i++)
+		learned_sum += index.lower_bound(lookups[i]);
+	double learned = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	learned_reads = sorted.blocks_read() - learned_reads;
+
+	long tree_reads = btree->blocks_read();
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < lookups.size(); i++)
+		btree_sum += btree->searchElem(lookups[i]);
+	double tree = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	tree_reads = btree->blocks_read() - tree_reads;
+
+	std::cout << "POSITIONS MATCH : " << (learned_sum == btree_sum) << std::endl;
+	std::cout << "SEGMENTS        : " << index.num_segments() << " (" << index.index_bytes() << " bytes for "
+		<< NUM_KEYS * sizeof(long) << " bytes of keys, built in " << build << " s)" << std::endl;
+	std::cout << "learned_index   : " << NUM_LOOKUPS / learned / 1e6 << " M lookups/s, "
+		<< (double) learned_reads / NUM_LOOKUPS << " blocks read per lookup" << std::endl;
+	std::cout << "BTree           : " << NUM_LOOKUPS / tree / 1e6 << " M lookups/s, "
+		<< (double) tree_reads / NUM_LOOKUPS << " blocks read per lookup" << std::endl;
+
+	delete btree;
+	return 0;
+}
@@ -0,0 +1,93 @@
+#include "packed_vector.h"
+#include <random>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#define NUM_INSERT 100000
+
+int main()
+{
+	std::default_random_engine generator;
+	std::uniform_int_distribution<long> distribution(1,1000);
+
+	auto dice = std::bind ( distribution, generator );
+
+	// sorted timestamps, the case delta encoding is for
+	std::vector<long> stamps;
+	long stamp = 1500000000;
+	for(auto i = 1; i<=NUM_INSERT; i++)
+		stamps.push_back(stamp += dice());
+
+	{
+		packed_vector<long> exvec("./packedvec", (size_t) 4096);
+		exvec.clear();
+
+		for(auto i = 0; i<1000; i++)
+			exvec.push_back(stamps[i]);
+		exvec.append(stamps.data() + 1000, stamps.size() - 1000);
+
+		std::cout << exvec.size() << " " << exvec.num_blocks() << " " << exvec.compressed_bytes() << std::endl;
+	}
+
+	// reopened, the short last block comes back as the tail
+	packed_vector<long> exvec("./packedvec", (size_t) 4096);
+	exvec.push_back(stamp + 1);
+
+	bool same = true;
+	for (auto it = 0; it < NUM_INSERT; it++)
+		same = same && exvec[it] == stamps[it];
+	std::cout << exvec.size() << " " << same << " " << exvec[NUM_INSERT] << std::endl;
+
+	long long total = 0, scanned = 0;
+	exvec.scan([&](long long, const long* data, size_t count) {
+		total += BlockKernels<long>::sum(data, count);
+		scanned += count;
+	});
+	std::cout << scanned << " " << total << std::endl;
+
+	// blocks outside the range are skipped on their index entry
+	scanned = 0;
+	exvec.scan(stamps[50000], stamps[50010], [&](long long, const long*, size_t count) { scanned += count; });
+	std::cout << scanned << std::endl;
+
+	auto range = exvec.minmax();
+	std::cout << range.first << " " << range.second << std::endl;
+
+	for (auto it = 0; it < exvec.size(); it += 5000)
+	{
+		std::cout << exvec[it] << std::endl;
+	}
+
+	// a block index that cannot be written is reported by close(), the destructor swallows it
+	unlink("./packedvec_close");
+	unlink("./packedvec_close.idx");
+	rmdir("./packedvec_close.idx");
+	{
+		packed_vector<int> closing("./packedvec_close", (size_t) 4096);
+		closing.push_back(1);
+		mkdir("./packedvec_close.idx", 0755);
+		try
+		{
+			closing.close();
+			std::cout << "closed" << std::endl;
+		}
+		catch(const std::runtime_error& e)
+		{
+			std::cout << e.what() << std::endl;
+		}
+	}
+	rmdir("./packedvec_close.idx");
+	{
+		packed_vector<int> closing("./packedvec_close", (size_t) 4096);
+		closing.push_back(2);
+		closing.push_back(3);
+		closing.close();
+	}
+	{
+		packed_vector<int> reopened("./packedvec_close", (size_t) 4096, BufferedFile::READ_ONLY);
+		std::cout << reopened.size() << " " << reopened[0] << " " << reopened[1] << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,42 @@
+#include "external_sort.h"
+#include <random>
+#include <functional>
+#include <iostream>
+
+#define NUM_INSERT 1000000
+
+int main()
+{
+	vector<int> sortvec("./sortvec", (size_t) 4096);
+	sortvec.clear();
+
+	std::default_random_engine generator;
+	std::uniform_int_distribution<int> distribution(1,1000000);
+
+	auto dice = std::bind ( distribution, generator );
+
+	for(auto i = 1; i<=NUM_INSERT; i++)
+		sortvec.push_back(dice());
+
+	// a 1MB budget spills the 4MB vector to disk as sorted runs
+	external_sort_stats stats = external_sort(sortvec, std::less<int>(), 1048576, ".");
+
+	bool sorted = true;
+	int prev = 0;
+	for (auto span : sortvec.cblocks())
+	{
+		for (auto it = span.begin(); it != span.end(); it++)
+		{
+			if(*it < prev)
+				sorted = false;
+			prev = *it;
+		}
+	}
+
+	std::cout << "SIZE : " << sortvec.size() << std::endl;
+	std::cout << "SORTED : " << sorted << std::endl;
+	std::cout << "RUNS : " << stats.runs << " PASSES : " << stats.passes << std::endl;
+	std::cout << "BYTES READ : " << stats.bytes_read << " BYTES WRITTEN : " << stats.bytes_written << std::endl;
+
+	return 0;
+}
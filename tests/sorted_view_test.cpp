@@ -0,0 +1,87 @@
+#include "vector.h"
+#include "sorted_view.h"
+#include <algorithm>
+#include <random>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#define NUM_INSERT 100000
+
+// every key from below the smallest to above the largest, answered as std::lower_bound/upper_bound would
+bool matches(vector<int>& exvec, const std::vector<int>& values, sorted_view<int>::Layout layout)
+{
+	sorted_view<int> view(exvec, std::less<int>(), layout);
+	bool same = true;
+	for(auto key = -1; key <= 1002; key++)
+	{
+		auto lower = std::lower_bound(values.begin(), values.end(), key) - values.begin();
+		auto upper = std::upper_bound(values.begin(), values.end(), key) - values.begin();
+		auto range = view.equal_range(key);
+		same = same && view.lower_bound(key) == lower && view.upper_bound(key) == upper
+			&& range.first == lower && range.second == upper;
+	}
+	return same;
+}
+
+int main()
+{
+	std::default_random_engine generator;
+	std::uniform_int_distribution<int> distribution(1,1000);
+
+	auto dice = std::bind ( distribution, generator );
+
+	std::vector<int> values;
+	for(auto i = 1; i<=NUM_INSERT; i++)
+		values.push_back(dice());
+	std::sort(values.begin(), values.end());
+
+	// 4096 byte blocks hold 1024 elements, 64 byte ones 16, so duplicates span many blocks
+	vector<int> exvec("./sortedvec", (size_t) 4096);
+	exvec.assign(values.data(), values.size());
+	vector<int> small("./sortedvec_small", (size_t) 64);
+	small.assign(values.data(), values.size());
+
+	std::cout << matches(exvec, values, sorted_view<int>::SORTED) << " " << matches(exvec, values, sorted_view<int>::EYTZINGER) << std::endl;
+	std::cout << matches(small, values, sorted_view<int>::SORTED) << " " << matches(small, values, sorted_view<int>::EYTZINGER) << std::endl;
+
+	// the index follows a change of size
+	sorted_view<int> view(exvec, std::less<int>(), sorted_view<int>::EYTZINGER);
+	std::cout << view.lower_bound(1001) << std::endl;
+	exvec.push_back(1001);
+	values.push_back(1001);
+	std::cout << view.lower_bound(1001) << " " << view.upper_bound(1001) << " " << matches(exvec, values, sorted_view<int>::SORTED) << std::endl;
+
+	// an empty vector gives 0 for every key
+	vector<int> empty("./sortedvec_empty", (size_t) 4096);
+	empty.clear();
+	std::vector<int> none;
+	std::cout << matches(empty, none, sorted_view<int>::SORTED) << " " << matches(empty, none, sorted_view<int>::EYTZINGER) << std::endl;
+
+	// a lookup reads the one block it searches and nothing ahead of it, with the plain pool and a large one
+	std::vector<int> many;
+	for(auto i = 0; i < 10 * NUM_INSERT; i++)
+		many.push_back(i);
+	{
+		vector<int> big("./sortedvec_big", (size_t) 4096);
+		big.assign(many.data(), many.size());
+	}
+	vector_options large_pool;
+	large_pool.pool_memory = 1 << 20;
+	large_pool.mode = BufferedFile::READ_ONLY;
+	vector<int> legacy("./sortedvec_big", (size_t) 4096, BufferedFile::READ_ONLY);
+	vector<int> pooled("./sortedvec_big", 4096, large_pool);
+	for(auto target : { &legacy, &pooled })
+	{
+		sorted_view<int> lookups(*target);
+		lookups.rebuild();
+		long before = lookups.blocks_read();
+		bool found = true;
+		// every key 37 blocks after the last, so no lookup finds its block cached
+		for(auto i = 0; i < 20; i++)
+			found = found && lookups.lower_bound(i * 37 * 1024 + 5) == i * 37 * 1024 + 5;
+		std::cout << found << " " << (lookups.blocks_read() - before) / 20.0 << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,61 @@
+#include "varvector.h"
+#include <random>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define NUM_INSERT 20000
+
+int main()
+{
+	std::default_random_engine generator;
+	std::uniform_int_distribution<int> distribution(0,200);
+
+	auto dice = std::bind ( distribution, generator );
+
+	std::vector<std::string> words;
+	for(auto i = 0; i<NUM_INSERT; i++)
+		words.push_back(std::string(dice(), 'a' + i % 26));
+	// longer than a block, spans several of them
+	words[777] = std::string(10000, '#');
+
+	varvector exvec("./varvec", (size_t) 4096);
+	exvec.clear();
+
+	exvec.append(words.begin(), words.begin() + NUM_INSERT / 2);
+
+	// the rest in one bulk append, payloads back to back
+	std::string payloads;
+	std::vector<uint64_t> lengths;
+	for(auto i = NUM_INSERT / 2; i<NUM_INSERT; i++)
+	{
+		payloads += words[i];
+		lengths.push_back(words[i].size());
+	}
+	exvec.append(payloads.data(), lengths.data(), lengths.size());
+
+	std::cout << exvec.size() << " " << exvec.heap_size() << std::endl;
+	std::cout << exvec.length(777) << " " << (exvec[777] == words[777]) << std::endl;
+
+	exvec.push_back("last");
+	std::cout << exvec[exvec.size() - 1] << std::endl;
+	exvec.pop_back();
+
+	bool same = true;
+	long long bytes = 0;
+	exvec.scan([&](long long n, const char* data, size_t length) {
+		same = same && words[n].compare(0, std::string::npos, data, length) == 0;
+		bytes += length;
+	});
+	std::cout << same << " " << bytes << std::endl;
+
+	std::string elem;
+	for (auto it = 0; it < exvec.size(); it += 2000)
+	{
+		exvec.get(it, elem);
+		std::cout << elem.size() << " " << elem.substr(0, 8) << std::endl;
+	}
+
+	return 0;
+}
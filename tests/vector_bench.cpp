@@ -0,0 +1,66 @@
+#include "vector.h"
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <vector>
+
+#define NUM_ELEMENTS 4000000
+#define NUM_LOOKUPS 20000000
+
+// random operator[] over the blocks that fit in the pool, so the index math
+// and the buffer lookup are measured rather than the disk
+template <typename Vector>
+double randomAccess(Vector& vec, const std::vector<long long>& indices, long long& checksum)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < indices.size(); i++)
+		checksum += vec[indices[i]];
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename Vector>
+double sequentialAccess(Vector& vec, long long& checksum)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (auto it = vec.cbegin(); it != vec.cend(); it++)
+		checksum += *it;
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main()
+{
+	{
+		vector<int> fill("./benchvec", (size_t) 4096);
+		std::vector<int> values(NUM_ELEMENTS);
+		for (size_t i = 0; i < values.size(); i++)
+			values[i] = i;
+		fill.assign(values.data(), values.size());
+	}
+
+	std::default_random_engine generator;
+	std::uniform_int_distribution<long long> distribution(0, 4 * 1024 - 1);
+	std::vector<long long> indices(NUM_LOOKUPS);
+	for (size_t i = 0; i < indices.size(); i++)
+		indices[i] = distribution(generator);
+
+	long long runtime_sum = 0, fixed_sum = 0;
+	double runtime_random, fixed_random, runtime_seq, fixed_seq;
+	{
+		vector<int> runtime_vec("./benchvec", (size_t) 4096);
+		runtime_random = randomAccess(runtime_vec, indices, runtime_sum);
+		runtime_seq = sequentialAccess(runtime_vec, runtime_sum);
+	}
+	{
+		vector<int, 4096> fixed_vec("./benchvec");
+		fixed_random = randomAccess(fixed_vec, indices, fixed_sum);
+		fixed_seq = sequentialAccess(fixed_vec, fixed_sum);
+	}
+
+	std::cout << "CHECKSUMS MATCH : " << (runtime_sum == fixed_sum) << std::endl;
+	std::cout << "RANDOM     vector<int>       : " << NUM_LOOKUPS / runtime_random / 1e6 << " M lookups/s" << std::endl;
+	std::cout << "RANDOM     vector<int, 4096> : " << NUM_LOOKUPS / fixed_random / 1e6 << " M lookups/s" << std::endl;
+	std::cout << "SEQUENTIAL vector<int>       : " << NUM_ELEMENTS / runtime_seq / 1e6 << " M elements/s" << std::endl;
+	std::cout << "SEQUENTIAL vector<int, 4096> : " << NUM_ELEMENTS / fixed_seq / 1e6 << " M elements/s" << std::endl;
+
+	return 0;
+}
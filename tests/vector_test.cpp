@@ -1,7 +1,10 @@
 #include "vector.h"
+#include "external_sort.h"
+#include <atomic>
 #include <random>
 #include <functional>
 #include <iostream>
+#include <thread>
 #include <vector>
 
 #define NUM_INSERT 8050
@@ -72,5 +75,330 @@ int main()
 	std::cout << std::endl;
 	std::cout << exvec.size() << std::endl;
 	
+	std::vector<int> bulk_vec;
+	for(auto i = 1; i<=3000; i++)
+		bulk_vec.push_back(dice());
+	exvec.append(bulk_vec.data(), bulk_vec.size());
+	exvec.append(bulk_vec.begin(), bulk_vec.begin() + 10);
+	
+	std::cout << std::endl;
+	std::cout << exvec.size() << std::endl;
+	
+	for (auto it = exvec.size() - 20; it < exvec.size(); it++)
+	{
+		std::cout << exvec[it] << std::endl;
+	}
+	
+	long long block_sum = 0;
+	for (auto span : exvec.cblocks())
+	{
+		for (auto elem : span)
+			block_sum += elem;
+	}
+	
+	std::cout << std::endl;
+	std::cout << exvec.num_blocks() << " " << block_sum << std::endl;
+	
+	exvec.assign(bulk_vec.begin(), bulk_vec.begin() + 5);
+	
+	std::cout << std::endl;
+	
+	for (auto it = exvec.begin(); it != exvec.end(); it++)
+	{
+		std::cout << *it << std::endl;
+	}
+	
+	exvec.reserve(100000);
+	exvec.resize(2050, 9);
+	
+	std::cout << std::endl;
+	std::cout << exvec.size() << " " << exvec.capacity() << " " << exvec.sum() << std::endl;
+	
+	exvec.resize(3);
+	exvec.shrink_to_fit();
+	
+	std::cout << exvec.size() << " " << exvec.capacity() << std::endl;
+	
+	{
+		vector<int>::stream_writer writer(exvec);
+		for(auto i = 1; i<=NUM_INSERT; i++)
+			writer << i;
+	}
+	
+	long long stream_sum = 0;
+	for (vector<int>::stream_reader reader(exvec); !reader.empty(); ++reader)
+		stream_sum += *reader;
+	
+	std::cout << exvec.size() << " " << stream_sum << " " << exvec.sum() << std::endl;
+	
+	std::vector<vector<int>::size_type> indices;
+	for(auto i = 1; i<=20; i++)
+		indices.push_back(dice() * 8);
+	std::vector<int> gathered;
+	exvec.gather(indices, gathered);
+	exvec.scatter(indices, std::vector<int>(indices.size(), 0));
+	
+	std::cout << std::endl;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		std::cout << indices[i] << " " << gathered[i] << " " << exvec[indices[i]] << std::endl;
+	}
+	
+	{
+		vector<int>::concurrent_appender appender(exvec, 2);
+		std::vector<std::thread> producers;
+		for(auto t = 1; t<=4; t++)
+			producers.push_back(std::thread([&appender, t]() {
+				vector<int>::concurrent_appender::producer producer(appender);
+				for(auto i = 1; i<=NUM_INSERT; i++)
+					producer << t;
+			}));
+		for(size_t t = 0; t < producers.size(); t++)
+			producers[t].join();
+		
+		std::cout << std::endl;
+		std::cout << appender.size() << std::endl;
+	}
+	
+	std::cout << exvec.size() << " " << exvec.sum() << " " << exvec.count(4) << std::endl;
+	
+	{
+		vector<int>::batch_edit batch(exvec);
+		for(auto i = 1; i<=100; i++)
+		{
+			batch.insert(i * 300, -i);
+			batch.erase(i * 350, i * 350 + 9);
+		}
+		std::cout << std::endl;
+		std::cout << batch.pending() << std::endl;
+		batch.apply();
+	}
+	
+	std::cout << exvec.size() << " " << exvec.sum() << " " << exvec[300] << " " << exvec[30000] << std::endl;
+	
+	{
+		vector<long> written("./readonlyvec", (size_t) 4096);
+		written.clear();
+		for(auto i = 1; i<=NUM_INSERT; i++)
+			written.push_back(i);
+	}
+	
+	{
+		// any number of readers share the file
+		vector<long> reader("./readonlyvec", (size_t) 4096, BufferedFile::READ_ONLY);
+		vector<long> mapped_reader("./readonlyvec", (size_t) 4096, BufferedFile::READ_ONLY_MAPPED);
+		const vector<long>& ro = reader;
+		const vector<long>& mapped = mapped_reader;
+		
+		long long ro_sum = 0;
+		bool same = true;
+		for (auto it = 0; it < reader.size(); it++)
+		{
+			ro_sum += ro[it];
+			same = same && ro[it] == mapped[it];
+		}
+		
+		std::cout << std::endl;
+		std::cout << reader.size() << " " << ro_sum << " " << mapped_reader.sum() << " " << same << std::endl;
+		
+		// writable access is refused instead of being dropped or faulting
+		try { reader[0] = 0; }
+		catch(const std::runtime_error& e) { std::cout << e.what() << std::endl; }
+		try { mapped_reader[0] = 0; }
+		catch(const std::runtime_error& e) { std::cout << e.what() << std::endl; }
+		std::cout << ro[0] << " " << mapped[0] << std::endl;
+		
+		// so is every write through the pool, the mapped frames are not even writable
+		std::vector< std::function<void(vector<long>&)> > writes = {
+			[](vector<long>& v) { v.scatter(std::vector<vector<long>::size_type>{ 1, 2 }, std::vector<long>{ 0, 0 }); },
+			[](vector<long>& v) { v.insert(v.begin() + 1, 0); },
+			[](vector<long>& v) { v.erase(v.begin() + 1, v.begin() + 2); },
+			[](vector<long>& v) { vector<long>::batch_edit batch(v); batch.erase(1); batch.apply(); }
+		};
+		for(size_t w = 0; w < writes.size(); w++)
+			for(auto target : { &reader, &mapped_reader })
+			{
+				try { writes[w](*target); std::cout << "written" << std::endl; }
+				catch(const std::runtime_error& e) { std::cout << e.what() << std::endl; }
+			}
+		std::cout << reader.size() << " " << mapped_reader.size() << " " << ro[1] << " " << mapped[2] << std::endl;
+		
+		// write errors come out of close(), a writer that is just dropped swallows them
+		{
+			vector<long>::stream_writer dropped(reader);
+			dropped << 1;
+		}
+		vector<long>::stream_writer writer(reader);
+		writer << 1;
+		try { writer.close(); }
+		catch(const std::runtime_error& e) { std::cout << e.what() << std::endl; }
+	}
+	
+	{
+		// a reservation keeps its space while the vector shrinks below it
+		vector<long> reserved("./reservevec", (size_t) 4096);
+		reserved.clear();
+		reserved.shrink_to_fit();
+		reserved.reserve(1 << 20);
+		for(auto i = 1; i<=NUM_INSERT; i++)
+			reserved.push_back(i);
+		for(auto i = 1; i<=NUM_INSERT/2; i++)
+			reserved.pop_back();
+		std::cout << std::endl;
+		std::cout << reserved.size() << " " << reserved.capacity() << std::endl;
+		
+		reserved.shrink_to_fit();
+		std::cout << reserved.size() << " " << reserved.capacity() << std::endl;
+		
+		// popping a few blocks keeps the preallocated tail, clearing a large vector gives it back
+		struct stat file_stat;
+		reserved.resize(1 << 22, 7);
+		long long grown = reserved.capacity();
+		stat("./reservevec", &file_stat);
+		long long grown_bytes = file_stat.st_blocks;
+		for(auto i = 1; i<=NUM_INSERT; i++)
+			reserved.pop_back();
+		stat("./reservevec", &file_stat);
+		std::cout << (reserved.capacity() == grown) << " " << (file_stat.st_blocks == grown_bytes) << std::endl;
+		
+		reserved.clear();
+		stat("./reservevec", &file_stat);
+		std::cout << reserved.capacity() << " " << (file_stat.st_blocks * 512 < 1048576) << std::endl;
+	}
+	
+	{
+		// files written before reserve() existed have garbage where the reservation is kept
+		{
+			vector<long> old_file("./reservevec", (size_t) 4096);
+			long elems[] = { 1, 2, 3 };
+			old_file.assign(elems, 3);
+		}
+		long garbage = 1L << 40;
+		int fd = open("./reservevec", O_RDWR);
+		pwrite(fd, &garbage, sizeof(garbage), sizeof(long) + sizeof(vector<long>::size_type));
+		close(fd);
+		
+		vector<long> old_file("./reservevec", (size_t) 4096);
+		std::cout << old_file.size() << " " << old_file.capacity() << std::endl;
+	}
+	
+	{
+		// iterators hold no pins, far more of them than the pool has frames can be live
+		vector<int>::const_iterator outlived;
+		{
+			vector<int> pinned("./randvec2", (size_t) 4096);
+			pinned.assign(exvec.cbegin(), exvec.cend());
+			
+			std::vector<vector<int>::const_iterator> live;
+			long long live_sum = 0, indexed_sum = 0;
+			for(auto i = 0; i < pinned.size(); i += 1000)
+			{
+				live.push_back(pinned.cbegin() + i);
+				live_sum += *live.back();
+				indexed_sum += pinned[i];
+			}
+			for(size_t i = 0; i < live.size(); i++)
+				live_sum += *live[i];
+			
+			std::cout << std::endl;
+			std::cout << live.size() << " " << (live_sum == 2 * indexed_sum) << std::endl;
+			outlived = live.back();
+		}
+		// going away after its vector is fine too
+	}
+	
+	{
+		vector<long> par("./parvec", (size_t) 4096);
+		std::vector<long> values;
+		for(long i = 1; i<=(1 << 20); i++)
+			values.push_back(i);
+		std::shuffle(values.begin(), values.end(), generator);
+		par.assign(values.data(), values.size());
+		
+		// a functor that only reads leaves the file alone
+		std::atomic<long long> seen(0);
+		par.parallel_for_each([&seen](const long& x) { seen += x; }, 4);
+		
+		par.parallel_for_each([](long& x) { if(x % 2 == 0) x = -x; }, 4);
+		par.parallel_transform([](long x) { return x < 0 ? -x : 2 * x; }, 4);
+		long long doubled = 0;
+		for(auto span : par.cblocks())
+			for(auto x : span)
+				doubled += x % 2 == 0 ? x : -1000000000;
+		
+		long total = par.parallel_reduce(0, [](long a, long b) { return a + b; }, 4);
+		long largest = par.parallel_reduce(0, [](long a, long b) { return std::max(a, b); }, 4);
+		
+		std::cout << std::endl;
+		std::cout << seen << " " << doubled << " " << total << " " << largest << std::endl;
+		
+		// runs sorted on the pool, merged from disk
+		external_sort(par, std::less<long>(), 1 << 20, ".", 4);
+		bool sorted = true;
+		long previous = 0;
+		for(auto span : par.cblocks())
+			for(auto x : span)
+			{
+				sorted = sorted && previous <= x;
+				previous = x;
+			}
+		std::cout << par.size() << " " << sorted << " " << par[0] << " " << par[par.size() - 1] << std::endl;
+	}
+	
+	// close() refuses while a producer still holds elements, neither destructor throws
+	{
+		vector<int> appended("./appendvec", (size_t) 4096);
+		appended.clear();
+		vector<int>::concurrent_appender appender(appended);
+		std::unique_ptr<vector<int>::concurrent_appender::producer> producer(new vector<int>::concurrent_appender::producer(appender));
+		producer->push(7);
+		
+		std::cout << std::endl;
+		try
+		{
+			appender.close();
+			std::cout << "closed" << std::endl;
+		}
+		catch(const std::runtime_error& e)
+		{
+			std::cout << e.what() << std::endl;
+		}
+		producer.reset();
+		appender.close();
+		std::cout << appender.size() << std::endl;
+		
+		// too late for this one, it is dropped
+		vector<int>::concurrent_appender::producer late(appender);
+		late.push(8);
+	}
+	{
+		vector<int> appended("./appendvec", (size_t) 4096);
+		std::cout << appended.size() << " " << appended[0] << std::endl;
+	}
+	
+	// a batch that cannot be applied throws from apply() and is dropped quietly by the destructor
+	{
+		vector<int> full("./batchvec", (size_t) 4096);
+		full.clear();
+		for(auto i = 0; i < 1024; i++)
+			full.push_back(i);
+	}
+	{
+		vector<int> full("./batchvec", (size_t) 4096, BufferedFile::READ_ONLY);
+		vector<int>::batch_edit batch(full);
+		batch.insert(1024, -1);
+		try
+		{
+			batch.apply();
+			std::cout << "applied" << std::endl;
+		}
+		catch(const std::runtime_error& e)
+		{
+			std::cout << e.what() << std::endl;
+		}
+		vector<int>::batch_edit dropped(full);
+		dropped.insert(1024, -1);
+	}
+	
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "vector.h"
+#include "vector_view.h"
+#include <algorithm>
+#include <random>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#define NUM_INSERT 100000
+
+int main()
+{
+	std::default_random_engine generator;
+	std::uniform_int_distribution<int> distribution(1,1000);
+
+	auto dice = std::bind ( distribution, generator );
+
+	std::vector<int> values;
+	for(auto i = 1; i<=NUM_INSERT; i++)
+		values.push_back(dice());
+
+	// 26 byte blocks leave padding after every 6 elements of 4 bytes, 4096 byte ones do not
+	{
+		vector<int> exvec("./viewvec", (size_t) 4096);
+		exvec.assign(values.data(), values.size());
+		vector<int> padded("./viewvec_padded", (size_t) 26);
+		padded.assign(values.data(), 1000);
+	}
+
+	vector_view<int> view("./viewvec", 4096);
+	std::cout << view.size() << " " << view.num_blocks() << " " << view.contiguous() << std::endl;
+
+	bool same = true;
+	for (auto it = 0; it < view.size(); it++)
+		same = same && view[it] == values[it];
+	std::cout << same << " " << std::equal(view.begin(), view.end(), values.begin()) << std::endl;
+
+	long long block_sum = 0, sum = 0;
+	for(auto span : view.blocks())
+		for(auto x : span)
+			block_sum += x;
+	for(size_t i = 0; i < values.size(); i++)
+		sum += values[i];
+	std::cout << (block_sum == sum) << " " << std::equal(view.data(), view.data() + view.size(), values.begin()) << std::endl;
+
+	vector_view<int> padded_view("./viewvec_padded", 26);
+	std::cout << padded_view.size() << " " << padded_view.contiguous() << " " << (padded_view.data() == nullptr) << " "
+		<< std::equal(padded_view.begin(), padded_view.end(), values.begin()) << std::endl;
+
+	// the advice only changes how the pages are read in, never what is read
+	view.advise(MADV_SEQUENTIAL);
+	view.advise(MADV_WILLNEED, 50000, 10000);
+	view.advise(MADV_RANDOM, NUM_INSERT - 1, 1);
+	std::cout << std::equal(view.begin() + 50000, view.begin() + 60000, values.begin() + 50000) << std::endl;
+
+	try
+	{
+		view.at(NUM_INSERT);
+	}
+	catch(const std::out_of_range& e)
+	{
+		std::cout << e.what() << std::endl;
+	}
+
+	// readers share the file under LOCK_SH, a writer has to wait for all of them
+	{
+		vector_view<int> second("./viewvec", 4096);
+		vector<int> reader("./viewvec", (size_t) 4096, BufferedFile::READ_ONLY);
+		const vector<int>& ro = reader;
+		std::cout << (second[777] == view[777]) << " " << (ro[777] == view[777]) << std::endl;
+
+		try
+		{
+			vector<int> writer("./viewvec", (size_t) 4096);
+			std::cout << "writer opened" << std::endl;
+		}
+		catch(const std::runtime_error& e)
+		{
+			std::cout << e.what() << std::endl;
+		}
+	}
+
+	// a sorted view is searched in place
+	std::sort(values.begin(), values.end());
+	{
+		vector<int> sorted("./viewvec_sorted", (size_t) 4096);
+		sorted.assign(values.data(), values.size());
+	}
+	vector_view<int> sorted_view("./viewvec_sorted", 4096);
+	bool found = true;
+	for(auto key = 0; key <= 1001; key += 7)
+		found = found && (std::lower_bound(sorted_view.begin(), sorted_view.end(), key) - sorted_view.begin())
+			== (std::lower_bound(values.begin(), values.end(), key) - values.begin());
+	std::cout << found << std::endl;
+
+	return 0;
+}